@@ -59,6 +59,9 @@ public class DppUE : ModuleRules
 			}
 			);
 		
+		// Voice streams encode to Opus themselves, so D++ only has to encrypt and send the packets.
+		AddEngineThirdPartyPrivateStaticDependencies(Target, "libOpus");
+
 		string BaseDirectory = Path.GetFullPath(Path.Combine(ModuleDirectory, "..", "..", "Source", "ThirdParty", "DppUELibrary"));
 		PublicIncludePaths.Add(Path.Combine(BaseDirectory, "Include"));
 	}
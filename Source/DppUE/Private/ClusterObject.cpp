@@ -3,59 +3,147 @@
 
 #include "ClusterObject.h"
 
-#include "AudioDecompress.h"
-#include "AudioThread.h"
+#include "Async/Async.h"
+#include "DppAttachmentCache.h"
+#include "DppCacheMemory.h"
+#include "DppReplyDeferrer.h"
+#include "DppRestCoalescer.h"
+#include "DppVoiceCache.h"
+#include "DppVoiceStream.h"
+#include "Misc/Parse.h"
+#include "UObject/PropertyTag.h"
 #include "codecvt"
 
-#define DPP_LOG_STR(x) UE_LOG(LogTemp, Display, TEXT("[DPP]: %s"), *FString(x.c_str()));
+#define DPP_LOG_STR(x) UE_LOG(LogTemp, Display, TEXT("[DPP]: %s"), *DppUE::Utf8ToFString(x));
 #define DPP_LOG_FSTR(x) UE_LOG(LogTemp, Display, TEXT("[DPP]: %s"), *FString(x));
 
-#define DPPUE_LOG_STR(x) UE_LOG(LogTemp, Display, TEXT("[DPP-UE]: %s"), *FString(x.c_str()));
+#define DPPUE_LOG_STR(x) UE_LOG(LogTemp, Display, TEXT("[DPP-UE]: %s"), *DppUE::Utf8ToFString(x));
 #define DPPUE_LOG_FSTR(x) UE_LOG(LogTemp, Display, TEXT("[DPP-UE]: %s"), *FString(x));
 
-#define DPPUE_WARN_STR(x) UE_LOG(LogTemp, Warning, TEXT("[DPP-UE]: %s"), *FString(x.c_str()));
+#define DPPUE_WARN_STR(x) UE_LOG(LogTemp, Warning, TEXT("[DPP-UE]: %s"), *DppUE::Utf8ToFString(x));
 #define DPPUE_WARN_FSTR(x) UE_LOG(LogTemp, Warning, TEXT("[DPP-UE]: %s"), *FString(x));
 
-#define DPPUE_ERR_STR(x) UE_LOG(LogTemp, Error, TEXT("[DPP-UE]: %s"), *FString(x.c_str()));
+#define DPPUE_ERR_STR(x) UE_LOG(LogTemp, Error, TEXT("[DPP-UE]: %s"), *DppUE::Utf8ToFString(x));
 #define DPPUE_ERR_FSTR(x) UE_LOG(LogTemp, Error, TEXT("[DPP-UE]: %s"), *FString(x));
 
-dpp::cluster* clusterRef{};
-dpp::discord_client* bot_client{};
-std::thread* bot_thread{};
-
-UClusterObject::UClusterObject()
+bool FDiscordSnowflake::ImportTextItem(const TCHAR*& Buffer, int32 PortFlags, UObject* Parent, FOutputDevice* ErrorText)
 {
+	const TCHAR* cursor = Buffer;
+
+	// A bare number, e.g. typed straight into a pin.
+	if(FChar::IsDigit(*cursor))
+	{
+		FString digits;
+
+		while(FChar::IsDigit(*cursor))
+			digits.AppendChar(*cursor++);
+
+		id = from_fstring(digits).id;
+		Buffer = cursor;
+		return true;
+	}
+
+	static const TCHAR legacy_prefix[] = TEXT("(snowflake_id=");
+
+	if(FCString::Strnicmp(cursor, legacy_prefix, UE_ARRAY_COUNT(legacy_prefix) - 1) != 0)
+		return false;
+
+	cursor += UE_ARRAY_COUNT(legacy_prefix) - 1;
+
+	FString value;
+
+	if(*cursor == TEXT('"'))
+	{
+		int32 num_chars_read = 0;
+
+		if(!FParse::QuotedString(cursor, value, &num_chars_read))
+			return false;
+
+		cursor += num_chars_read;
+	}
+	else
+	{
+		while(*cursor && *cursor != TEXT(')') && *cursor != TEXT(','))
+			value.AppendChar(*cursor++);
+	}
+
+	// Nothing else was ever in the old struct, skip to the end of it.
+	while(*cursor && *cursor != TEXT(')'))
+		++cursor;
+
+	if(*cursor != TEXT(')'))
+		return false;
+
+	id = from_fstring(value.TrimStartAndEnd()).id;
+	Buffer = cursor + 1;
+	return true;
 }
 
-void UClusterObject::BeginDestroy()
+bool FDiscordSnowflake::SerializeFromMismatchedTag(const FPropertyTag& Tag, FArchive& Ar)
 {
+	if(Tag.Type == NAME_StrProperty)
+	{
+		FString string_id;
+		Ar << string_id;
+		id = from_fstring(string_id).id;
+		return true;
+	}
 
-	if(!bot_alive)
+	if(Tag.Type == NAME_UInt64Property)
 	{
-		UObject::BeginDestroy();
-		return;
+		Ar << id;
+		return true;
 	}
-	
-	commands_to_register.Empty();
 
-	// Wipe bot client ref.
-	if(bot_client)
-		delete bot_client;
+	return false;
+}
 
-	if(clusterRef)
+void FDiscordSnowflake::PostSerialize(const FArchive& Ar)
+{
+	if(Ar.IsLoading() && !snowflake_id_DEPRECATED.IsEmpty())
 	{
-		stop_bot = true;
-		bot_thread->join();
-
-		clusterRef = nullptr;
-		bot_thread = nullptr;
+		id = from_fstring(snowflake_id_DEPRECATED).id;
+		snowflake_id_DEPRECATED.Empty();
 	}
+}
+
+UClusterObject::UClusterObject()
+{
+	voice_cache = MakeShared<FDppVoiceCache, ESPMode::ThreadSafe>(static_cast<int64>(voice_cache_budget_mb) * 1024 * 1024);
+	attachment_cache = MakeShared<FDppAttachmentCache, ESPMode::ThreadSafe>(static_cast<int64>(attachment_cache_budget_mb) * 1024 * 1024);
+	reply_deferrer = MakeShared<FDppReplyDeferrer, ESPMode::ThreadSafe>();
+	rest_coalescer = MakeShared<FDppRestCoalescer, ESPMode::ThreadSafe>();
+}
+
+void UClusterObject::BeginDestroy()
+{
+	commands_to_register.Empty();
+
+	// Only asks the bot thread to stop, IsReadyForFinishDestroy holds off destruction until it's done.
+	StopBot();
 
-	bot_alive = false;
-	
 	UObject::BeginDestroy();
 }
 
+bool UClusterObject::IsReadyForFinishDestroy()
+{
+	// The stopping clusters' handlers still point at this object, it can't go until they're gone.
+	for(const TUniquePtr<FBotRun>& run : stopping_runs)
+	{
+		if(!run->finished)
+			return false;
+	}
+
+	return !bot_run && UObject::IsReadyForFinishDestroy();
+}
+
+void UClusterObject::FinishDestroy()
+{
+	ReapBotRuns(true);
+
+	UObject::FinishDestroy();
+}
+
 void UClusterObject::CreateBot(const FString& token, const bool enableMessageIntent, const bool enableGuildIntent, const bool enableGuildPresenceIntent)
 {
 	if(token.IsEmpty())
@@ -63,7 +151,13 @@ void UClusterObject::CreateBot(const FString& token, const bool enableMessageInt
 		DPPUE_ERR_FSTR("The token is empty. Aborting bot start.");
 		return;
 	}
-	
+
+	if(clusterRef || IsBotRunning())
+	{
+		DPPUE_ERR_FSTR("A bot has already been created. Call StopBot before creating another one.");
+		return;
+	}
+
 	uint32_t intent = dpp::i_default_intents;
  
 	if(enableMessageIntent)
@@ -74,99 +168,429 @@ void UClusterObject::CreateBot(const FString& token, const bool enableMessageInt
 
 	if(enableGuildPresenceIntent)
 		intent = intent | dpp::i_guild_presences;
-	
+
+	bot_token = DppUE::ToUtf8(token);
+	bot_intents = intent;
+
+	ResizeEventQueues();
+	SetupCluster();
+}
+
+void UClusterObject::SetupCluster()
+{
 	// Create bot.
-	clusterRef = new dpp::cluster(std::string(TCHAR_TO_UTF8(*token)), intent);
+	++cluster_generation;
+	clusterRef = new dpp::cluster(bot_token, bot_intents, static_cast<uint32_t>(FMath::Max(shard_count, 0)), 0, 1, compress_gateway, cache_policy.to_cache_policy(), FMath::Max(rest_request_threads, 1));
+	rest_coalescer->SetCluster(clusterRef);
 
 	clusterRef->on_log([](const dpp::log_t& event)
 	{
 		DPP_LOG_STR(event.message);
 	});
 
-	clusterRef->on_slashcommand([this](const dpp::slashcommand_t& event)
+	// Captured by value, the handlers must never read cluster_generation itself from the shard threads.
+	const uint32 generation = cluster_generation;
+
+	clusterRef->on_slashcommand([this, generation](const dpp::slashcommand_t& event)
 	{
 		FSlashcommand_Event command_event;
-		command_event.command_name = FString(event.command.get_command_name().c_str());
-		command_event.issuing_user = FString(event.command.get_issuing_user().global_name.c_str());
-
-		// We can't do a lot of UE stuff on a separate thread, so we need to make sure that "OnSlashCommand" happens on the GameThread.
-		AsyncTask(ENamedThreads::Type::GameThread, [this, event, command_event]
+		command_event.command_name = event.command.get_command_name();
+		command_event.issuing_user = event.command.get_issuing_user().global_name;
+		command_event.issuing_user_id = event.command.get_issuing_user().id;
+		command_event.interaction_id = event.command.id;
+		command_event.interaction_token = event.command.token;
+
+		// The clock starts now, not when the GameThread gets to it, as that's what Discord's deadline counts from.
+		const TSharedPtr<FDppPendingReply, ESPMode::ThreadSafe> pending_reply = reply_deferrer->MakePendingReply(event.from->creator, generation, event.command.id, event.command.token);
+		command_event.pending_reply = pending_reply;
+
+		// We can't do a lot of UE stuff on a separate thread, so "OnSlashCommand" gets dispatched from the queue on the GameThread.
+		if(QueueEvent(generation, FClusterQueuedEvent(TInPlaceType<FSlashcommand_Event>(), MoveTemp(command_event))))
 		{
-			FSlashcommand_Reply command_reply = OnSlashcommand(command_event);
-
-			const dpp::message msg{GenerateDPPMessage(command_reply.reply)};
+			// Only deferred once it's queued, a dropped command would otherwise be left "thinking" with nothing to ever answer it.
+			reply_deferrer->Track(pending_reply);
+			return;
+		}
 
-			event.reply(msg);
-		});
+		// The GameThread will never see this one, so answer it here rather than let it time out.
+		dpp::message busy_reply("The server is too busy to handle this command right now, please try again.");
+		busy_reply.set_flags(dpp::m_ephemeral);
+		pending_reply->Reply(*event.from->creator, MoveTemp(busy_reply));
 	});
 
-	clusterRef->on_message_create([this](const dpp::message_create_t& event)
+	clusterRef->on_message_create([this, generation](const dpp::message_create_t& event)
 	{
-		if(event.msg.author.id.empty() || event.msg.author.id == clusterRef->me.id)
+		if(event.msg.author.id.empty() || event.msg.author.id == event.from->creator->me.id)
 		{
 			DPPUE_WARN_FSTR("Message was sent by an empty ID or was sent by self. Ignoring.");
 			return;
 		}
 		
+		// Strings stay as UTF-8 here, they only get converted if a Blueprint reads them.
 		FMessage_event message_event;
-		FDiscordMessage message;
-		message.content = FString(event.msg.content.c_str());
-		message.isEmpherial = false;
-		message_event.message = message;
-		message_event.message_creator = FString(event.msg.author.global_name.c_str());
-		
-		OnMessageCreate.Broadcast(message_event);
+		message_event.message.channel_id = event.msg.channel_id;
+		message_event.message.isEmpherial = false;
+		message_event.content = event.msg.content;
+		message_event.message_creator = event.msg.author.global_name;
+		message_event.message_creator_id = event.msg.author.id;
+
+		// Blueprints can't run on the shard thread, and a slow handler would stall the whole shard. Hand it to the GameThread.
+		QueueMessage(generation, MoveTemp(message_event));
 	});
 
-	clusterRef->on_button_click([this](const dpp::button_click_t& event)
+	clusterRef->on_button_click([this, generation](const dpp::button_click_t& event)
 	{
 		FButtonClick_Event buttonclick_event;
-		buttonclick_event.custom_id = FString(event.custom_id.c_str());
-		buttonclick_event.issuing_user = FString(event.command.get_issuing_user().global_name.c_str());
-		buttonclick_event.raw_event = event;
+		buttonclick_event.custom_id = event.custom_id;
+		buttonclick_event.issuing_user = event.command.get_issuing_user().global_name;
+		buttonclick_event.issuing_user_id = event.command.get_issuing_user().id;
+		buttonclick_event.interaction_id = event.command.id;
+		buttonclick_event.interaction_token = event.command.token;
 
 		//event.thinking(true);
-		
-		AsyncTask(ENamedThreads::Type::GameThread, [this, event, buttonclick_event]
-		{
-			OnButtonClick.Broadcast(buttonclick_event);
-		});
+
+		QueueEvent(generation, FClusterQueuedEvent(TInPlaceType<FButtonClick_Event>(), MoveTemp(buttonclick_event)));
 	});
 	
+	clusterRef->on_voice_state_update([this, generation](const dpp::voice_state_update_t& event)
+	{
+		// Only the bot's own voice state matters, an empty channel means its connection in that guild is gone.
+		if(event.state.user_id != event.from->creator->me.id || !event.state.channel_id.empty())
+			return;
+
+		QueueEvent(generation, FClusterQueuedEvent(TInPlaceType<FVoiceDisconnect_QueuedEvent>(), FVoiceDisconnect_QueuedEvent{event.state.guild_id}));
+	});
+
 	// When bot is ready, register all our commands and fire OnClusterReady.
-	clusterRef->on_ready([this](const dpp::ready_t& event)
+	// Per cluster rather than dpp::run_once, which is global and would skip every bot after the first.
+	// A cluster still shutting down after a restart can fire on_ready too, so this can't be shared with the new one either.
+	TSharedRef<std::atomic<bool>, ESPMode::ThreadSafe> commands_registered = MakeShared<std::atomic<bool>, ESPMode::ThreadSafe>(false);
+
+	clusterRef->on_ready([this, generation, commands_registered](const dpp::ready_t& event)
 	{
-		if(dpp::run_once <struct register_bot_commands>())
+		if(!commands_registered->exchange(true))
 		{
 			std::vector<dpp::slashcommand> temp_commands;
 
 			for(FSlashcommand_Data command_data : commands_to_register)
-				temp_commands.emplace_back(command_data.name_to_string(), command_data.description_to_string(), clusterRef->me.id);
+				temp_commands.emplace_back(command_data.name_to_string(), command_data.description_to_string(), event.from->creator->me.id);
 			
-			clusterRef->global_bulk_command_create(temp_commands);
+			event.from->creator->global_bulk_command_create(temp_commands);
 		}
 
-		bot_client = event.from;
-		bot_alive = true;
-		OnClusterReady.Broadcast();
+		// A shard of a cluster that's shutting down can still reconnect and fire this, so it goes through the queue like every other event.
+		QueueEvent(generation, FClusterQueuedEvent(TInPlaceType<FClusterReady_QueuedEvent>(), FClusterReady_QueuedEvent{event.from}));
 	});
 }
 
 void UClusterObject::StartBot()
 {
-	// Now, let's start.
-	bot_thread = new std::thread([this]
+	if(bot_run)
+	{
+		DPPUE_WARN_FSTR("The bot is already running.");
+		return;
+	}
+
+	ReapBotRuns(false);
+	ResizeEventQueues();
+
+	// StopBot hands the cluster to its bot thread to delete, so restarting needs a fresh one.
+	if(!clusterRef)
+	{
+		if(bot_token.empty())
+		{
+			DPPUE_ERR_FSTR("There is no bot to start. Call CreateBot first.");
+			return;
+		}
+
+		SetupCluster();
+	}
+
+	reply_deferrer->SetBudget(auto_defer_replies ? FMath::Max(defer_reply_after_seconds, 0.0f) : -1.0);
+	reply_deferrer->SetEphemeral(defer_replies_ephemeral);
+	reply_deferrer->Start(cluster_generation);
+
+	bot_run = MakeUnique<FBotRun>();
+
+	// Now, let's start. The thread only touches its own run, so older runs can still be shutting down next to it.
+	bot_run->thread = std::thread([run = bot_run.Get(), cluster = clusterRef]
 	{
-		if(clusterRef != nullptr)
-			clusterRef->start(dpp::st_return);
+		try
+		{
+			cluster->start(dpp::st_return);
+		}
+		catch(const std::exception& e)
+		{
+			DPPUE_ERR_STR(std::string("Failed to start the bot. ") + e.what());
+		}
 
-		while(!stop_bot)
+		// Sleep until StopBot, rather than polling, so stopping is never held up by a sleep.
 		{
-			std::this_thread::sleep_for(std::chrono::seconds(1));
+			std::unique_lock lock(run->mutex);
+			run->cv.wait(lock, [run] { return run->stop; });
 		}
+
+		cluster->shutdown();
+		delete cluster;
+
+		run->finished = true;
 	});
 }
 
+void UClusterObject::StopBot()
+{
+	StopVoiceStreams();
+	rest_coalescer->SetCluster(nullptr);
+
+	if(!IsBotRunning())
+	{
+		// Created but never started (or already stopped), nothing else owns the cluster.
+		delete clusterRef;
+		clusterRef = nullptr;
+		return;
+	}
+
+	// Deferrals go through the cluster, so this has to stop before the bot thread deletes it.
+	reply_deferrer->StopAndWait();
+
+	// The bot thread owns the cluster from here, it deletes it once the shards are down.
+	clusterRef = nullptr;
+	bot_client = nullptr;
+	bot_alive = false;
+
+	{
+		std::lock_guard lock(bot_run->mutex);
+		bot_run->stop = true;
+	}
+
+	bot_run->cv.notify_all();
+
+	// Anything it still queues on the way down is from an old generation, and gets dropped.
+	stopping_runs.Add(MoveTemp(bot_run));
+}
+
+void UClusterObject::RestartBot()
+{
+	StopBot();
+	StartBot();
+}
+
+bool UClusterObject::IsBotRunning() const
+{
+	return bot_run.IsValid();
+}
+
+void UClusterObject::ReapBotRuns(const bool wait)
+{
+	for(int32 index = stopping_runs.Num() - 1; index >= 0; --index)
+	{
+		if(!wait && !stopping_runs[index]->finished)
+			continue;
+
+		stopping_runs[index]->thread.join();
+		stopping_runs.RemoveAt(index);
+	}
+}
+
+void UClusterObject::ResizeEventQueues()
+{
+	// Resizing isn't safe while anything can push, and a cluster that's still shutting down can. It'll apply on a later start instead.
+	if(stopping_runs.Num() > 0)
+		return;
+
+	event_queue.Reset(FMath::Max(event_queue_capacity, 1));
+	message_queue.Reset(FMath::Max(message_queue_capacity, 1));
+}
+
+void UClusterObject::Tick(float DeltaTime)
+{
+	DrainEventQueue();
+	TickCacheStats(DeltaTime);
+	ReapBotRuns(false);
+
+	rest_coalescer->SetBatchWindow(delete_batch_window_seconds);
+	rest_coalescer->Flush();
+}
+
+ETickableTickType UClusterObject::GetTickableTickType() const
+{
+	// The CDO never has a bot, so there's no point in it ever ticking.
+	return HasAnyFlags(RF_ClassDefaultObject) ? ETickableTickType::Never : ETickableTickType::Conditional;
+}
+
+bool UClusterObject::IsTickable() const
+{
+	return !event_queue.IsEmpty() || !message_queue.IsEmpty() || stopping_runs.Num() > 0 || rest_coalescer->HasPendingDeletes() || (cache_stats_interval_seconds > 0.0f && IsBotRunning());
+}
+
+bool UClusterObject::IsTickableInEditor() const
+{
+	// Editor utility widgets can own a bot too.
+	return true;
+}
+
+TStatId UClusterObject::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UClusterObject, STATGROUP_Tickables);
+}
+
+bool UClusterObject::QueueEvent(const uint32 generation, FClusterQueuedEvent&& event)
+{
+	if(event_queue.Push(FClusterQueueEntry{generation, MoveTemp(event)}))
+		return true;
+
+	// Only warn on the first drop of every batch, otherwise a burst would flood the log from every shard.
+	if(FMath::IsPowerOfTwo(event_queue.NumDropped()))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("[DPP-UE]: The event queue is full (%u events). %llu events have been dropped so far, consider raising event_queue_capacity or max_events_per_frame."),
+			event_queue.Capacity(), event_queue.NumDropped());
+	}
+
+	return false;
+}
+
+bool UClusterObject::QueueMessage(const uint32 generation, FMessage_event&& event)
+{
+	if(message_queue.Push(FClusterMessageEntry{generation, MoveTemp(event)}))
+		return true;
+
+	if(FMath::IsPowerOfTwo(message_queue.NumDropped()))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("[DPP-UE]: The message queue is full (%u messages). %llu messages have been dropped so far, consider raising message_queue_capacity or max_messages_per_frame."),
+			message_queue.Capacity(), message_queue.NumDropped());
+	}
+
+	return false;
+}
+
+void UClusterObject::DrainEventQueue()
+{
+	int32 budget = max_events_per_frame > 0 ? max_events_per_frame : MAX_int32;
+	FClusterQueueEntry entry;
+
+	while(budget > 0 && event_queue.Pop(entry))
+	{
+		--budget;
+
+		// Left over from a cluster that has been stopped (and maybe replaced by now), nothing it refers to is valid anymore.
+		if(!clusterRef || entry.cluster_generation != cluster_generation)
+			continue;
+
+		++events_dispatched;
+
+		FClusterQueuedEvent& queued_event = entry.event;
+
+		if(const FSlashcommand_Event* command_event = queued_event.TryGet<FSlashcommand_Event>())
+		{
+			DispatchSlashcommand(*command_event);
+		}
+		else if(const FButtonClick_Event* buttonclick_event = queued_event.TryGet<FButtonClick_Event>())
+		{
+			OnButtonClick.Broadcast(*buttonclick_event);
+		}
+		else if(const FClusterReady_QueuedEvent* ready_event = queued_event.TryGet<FClusterReady_QueuedEvent>())
+		{
+			bot_client = ready_event->shard;
+			bot_alive = true;
+			OnClusterReady.Broadcast();
+		}
+		else if(const FVoiceDisconnect_QueuedEvent* voice_disconnect_event = queued_event.TryGet<FVoiceDisconnect_QueuedEvent>())
+		{
+			// The stream has already stopped sending by now, as the voice client is gone. This cleans it up.
+			StopAudioInGuild(FDiscordSnowflake(voice_disconnect_event->guild_id));
+		}
+	}
+
+	// Messages only get what's left of the frame once every interaction that was waiting has gone out.
+	int32 message_budget = max_messages_per_frame > 0 ? max_messages_per_frame : MAX_int32;
+	FClusterMessageEntry message_entry;
+
+	while(message_budget > 0 && message_queue.Pop(message_entry))
+	{
+		--message_budget;
+
+		if(!clusterRef || message_entry.cluster_generation != cluster_generation)
+			continue;
+
+		++messages_dispatched;
+
+		if(batch_message_delivery)
+			message_batch.Add(MoveTemp(message_entry.event));
+		else
+			OnMessageCreate.Broadcast(message_entry.event);
+	}
+
+	if(message_batch.Num() > 0)
+	{
+		OnMessagesCreated.Broadcast(message_batch);
+		message_batch.Reset();
+	}
+}
+
+void UClusterObject::DispatchSlashcommand(const FSlashcommand_Event& command_event)
+{
+	// Left over from a bot that has since been stopped, there's nothing to reply through anymore.
+	if(!clusterRef)
+		return;
+
+	FSlashcommand_Reply command_reply = OnSlashcommand(command_event);
+
+	// Attachments are loaded off the GameThread, so the bot can be restarted before the reply is ready.
+	GenerateDPPMessageAsync(command_reply.reply, [this, generation = cluster_generation, pending_reply = command_event.pending_reply, interaction_id = command_event.interaction_id, interaction_token = command_event.interaction_token](dpp::message&& msg)
+	{
+		if(!clusterRef || generation != cluster_generation)
+			return;
+
+		// Events made by hand in C++ aren't tracked, so they can only be replied to directly.
+		if(!pending_reply)
+		{
+			clusterRef->interaction_response_create(interaction_id, interaction_token, dpp::interaction_response(dpp::ir_channel_message_with_source, msg));
+			return;
+		}
+
+		// Always sent through the current cluster, never the one the reply was tracked from, which could be deleted by now.
+		if(pending_reply->GetClusterGeneration() == cluster_generation)
+			reply_deferrer->Reply(*clusterRef, *pending_reply, MoveTemp(msg));
+	});
+}
+
+FInteractionReplyStats UClusterObject::GetInteractionReplyStats() const
+{
+	const FDppReplyDeferrer::FStats deferrer_stats = reply_deferrer->GetStats();
+
+	FInteractionReplyStats stats;
+	stats.replies = deferrer_stats.replies;
+	stats.deferred = deferrer_stats.deferred;
+	stats.last_latency_ms = static_cast<float>(deferrer_stats.last_latency * 1000.0);
+	stats.average_latency_ms = static_cast<float>(deferrer_stats.average_latency * 1000.0);
+	stats.max_latency_ms = static_cast<float>(deferrer_stats.max_latency * 1000.0);
+	return stats;
+}
+
+FEventQueueStats UClusterObject::GetEventQueueStats() const
+{
+	FEventQueueStats stats;
+	stats.capacity = event_queue.Capacity();
+	stats.pending = event_queue.Num();
+	stats.pushed = event_queue.NumPushed();
+	stats.dispatched = events_dispatched;
+	stats.dropped = event_queue.NumDropped();
+	stats.high_watermark = event_queue.HighWatermark();
+	return stats;
+}
+
+FEventQueueStats UClusterObject::GetMessageQueueStats() const
+{
+	FEventQueueStats stats;
+	stats.capacity = message_queue.Capacity();
+	stats.pending = message_queue.Num();
+	stats.pushed = message_queue.NumPushed();
+	stats.dispatched = messages_dispatched;
+	stats.dropped = message_queue.NumDropped();
+	stats.high_watermark = message_queue.HighWatermark();
+	return stats;
+}
+
 void UClusterObject::CreateCommand(FSlashcommand_Data command)
 {
 	commands_to_register.Add(command);
@@ -190,20 +614,24 @@ FSlashcommand_Reply UClusterObject::OnSlashcommand_Implementation(FSlashcommand_
 
 void UClusterObject::ButtonClickReply(FButtonClick_Event button_event, FButtonClick_Reply button_reply)
 {
-	const dpp::message msg{GenerateDPPMessage(button_reply.reply)};
-
-	if(button_reply.editInteractedMessage)
-	{
-		button_event.raw_event.reply(dpp::ir_update_message, msg);
-	} else
+	if(!clusterRef)
 	{
-		button_event.raw_event.reply(msg);
+		DPPUE_WARN_FSTR("The bot isn't running, so the button click can't be replied to.");
+		return;
 	}
+
+	const dpp::interaction_response_type response_type = button_reply.editInteractedMessage ? dpp::ir_update_message : dpp::ir_channel_message_with_source;
+
+	GenerateDPPMessageAsync(button_reply.reply, [this, response_type, interaction_id = button_event.interaction_id, interaction_token = button_event.interaction_token](dpp::message&& msg)
+	{
+		if(clusterRef)
+			clusterRef->interaction_response_create(interaction_id, interaction_token, dpp::interaction_response(response_type, msg));
+	});
 }
 
 bool UClusterObject::JoinVoiceChannel(FDiscordSnowflake GuildID, FDiscordSnowflake UserID)
 {
-	dpp::guild* guild = dpp::find_guild(GuildID.string_id_to_snowflake());
+	dpp::guild* guild = dpp::find_guild(GuildID.to_snowflake());
 
 	if(!guild)
 	{
@@ -211,23 +639,60 @@ bool UClusterObject::JoinVoiceChannel(FDiscordSnowflake GuildID, FDiscordSnowfla
 		return false;
 	}
 
-	if(!guild->connect_member_voice(UserID.string_id_to_snowflake()))
+	// guild::connect_member_voice would connect through the shard in D++'s global voice state cache, which can belong to another bot in this process.
+	const auto voice_state = guild->voice_members.find(UserID.to_snowflake());
+
+	if(voice_state == guild->voice_members.end() || voice_state->second.channel_id.empty())
 	{
-		DPPUE_WARN_FSTR("Failed to connect to the user's voice channel.");
+		DPPUE_WARN_FSTR("Failed to connect to the user's voice channel. The user isn't in one.");
 		return false;
 	}
 
+	dpp::discord_client* shard = GetGuildShard(GuildID);
+
+	if(!shard)
+	{
+		DPPUE_WARN_FSTR("The bot isn't ready yet, so it can't join a voice channel.");
+		return false;
+	}
+
+	shard->connect_voice(guild->id, voice_state->second.channel_id);
 	return true;
 }
 
 void UClusterObject::LeaveVoiceChannel(FDiscordSnowflake VoiceChannel)
 {
-	bot_client->disconnect_voice(VoiceChannel.string_id_to_snowflake());
+	// The stream sends through the voice client, so it has to stop before the client is deleted.
+	StopAudioInGuild(VoiceChannel);
+
+	dpp::discord_client* shard = GetGuildShard(VoiceChannel);
+
+	if(!shard)
+	{
+		DPPUE_WARN_FSTR("The bot isn't ready yet, so it isn't in any voice channel.");
+		return;
+	}
+
+	shard->disconnect_voice(VoiceChannel.to_snowflake());
 }
 
 bool UClusterObject::PlayAudioInGuild(FDiscordSnowflake GuildID, USoundWave* SoundWave)
 {
-	dpp::voiceconn* v = bot_client->get_voice(GuildID.string_id_to_snowflake());
+	dpp::discord_client* shard = GetGuildShard(GuildID);
+
+	if(!shard)
+	{
+		DPPUE_WARN_FSTR("The bot isn't ready yet, so it can't play audio.");
+		return false;
+	}
+
+	if(!SoundWave)
+	{
+		DPPUE_WARN_FSTR("No sound wave was passed into 'PlayAudioInGuild'.");
+		return false;
+	}
+
+	dpp::voiceconn* v = shard->get_voice(GuildID.to_snowflake());
 
 	if(!v || !v->voiceclient || !v->voiceclient->is_ready())
 	{
@@ -241,121 +706,274 @@ bool UClusterObject::PlayAudioInGuild(FDiscordSnowflake GuildID, USoundWave* Sou
 		return false;
 	}
 
-	if (SoundWave->RawPCMData == nullptr)
+	StopAudioInGuild(GuildID);
+
+	// The budget can be changed from Blueprints at any time.
+	voice_cache->SetBudget(static_cast<int64>(voice_cache_budget_mb) * 1024 * 1024);
+
+	// Only grabs what's needed from the asset here, the decoding, resampling and sending all happen on the stream's thread.
+	TSharedPtr<FDppVoiceStream> stream = FDppVoiceStream::Create(shard, GuildID.to_snowflake(), SoundWave, voice_lookahead_seconds, voice_cache);
+
+	if(!stream)
+		return false;
+
+	stream->Start();
+	voice_streams.Add(GuildID, stream);
+
+	return true;
+}
+
+dpp::discord_client* UClusterObject::GetGuildShard(const FDiscordSnowflake GuildID) const
+{
+	if(!clusterRef || !bot_client)
+		return nullptr;
+
+	// Discord's own formula. This bot runs every shard in one cluster, so every shard is local.
+	const uint32_t num_shards = clusterRef->numshards;
+
+	if(num_shards <= 1)
+		return bot_client;
+
+	return clusterRef->get_shard(static_cast<uint32_t>((GuildID.id >> 22) % num_shards));
+}
+
+void UClusterObject::StopAudioInGuild(FDiscordSnowflake GuildID)
+{
+	TSharedPtr<FDppVoiceStream> stream;
+
+	if(voice_streams.RemoveAndCopyValue(GuildID, stream))
+		stream->StopAndWait();
+}
+
+void UClusterObject::PrecacheSound(USoundWave* SoundWave)
+{
+	if(!SoundWave || SoundWave->bProcedural)
 	{
-		//UE_LOG(LogTemp, Display, TEXT("[DPP-UE]: %s"), *FString("Could not find any PCM data for the SoundWave passed into 'PlayAudioInGuild'. Calculationg PCM Data..."));
-		DPPUE_LOG_FSTR("Could not find any PCM data for the SoundWave passed into 'PlayAudioInGuild'. Calculationg PCM Data...");
+		DPPUE_WARN_FSTR("Only non-procedural sound waves can be precached.");
+		return;
+	}
 
-		// We have to tell the GameThread to do all the decompressing. It would be the audio thread but I can't seem to get access to that thread.
-		FAudioThread::RunCommandOnAudioThread([this, SoundWave, v]
-		{
+	voice_cache->SetBudget(static_cast<int64>(voice_cache_budget_mb) * 1024 * 1024);
 
-			FAudioDevice* AudioDevice = GEngine->GetMainAudioDeviceRaw();
+	precache_streams.RemoveAll([](const TSharedPtr<FDppVoiceStream>& stream) { return stream->IsFinished(); });
 
-			if(!AudioDevice)
-			{
-				DPPUE_ERR_FSTR("Could not find a main audio device. Raw PCM Data could not be gathered.");
-				return false;
-			}
-			
-			EDecompressionType DecompressionType = SoundWave->DecompressionType;
-			SoundWave->DecompressionType = DTYPE_Native;
+	TSharedPtr<FDppVoiceStream> stream = FDppVoiceStream::CreatePrecache(SoundWave, voice_cache);
 
-			FName format = SoundWave->GetRuntimeFormat();
-			
-			FByteBulkData* Bulk = SoundWave->GetCompressedData(format, SoundWave->GetPlatformCompressionOverridesForCurrentPlatform());
+	if(!stream)
+		return;
 
-			if(!Bulk)
-			{
-				DPPUE_ERR_FSTR("Failed to get the compressed data from the sound wave.");
-				return false;
-			}
-		
-			SoundWave->InitAudioResource(*Bulk);
-	
-			if (SoundWave->DecompressionType != DTYPE_RealTime || SoundWave->CachedRealtimeFirstBuffer == nullptr)
-			{
-				DPPUE_LOG_FSTR("Need to de-compress SoundWave. Proceeding with operation...");
-			
-				const float timeStarted = GetWorld()->RealTimeSeconds * 1000;
-			
-				FAsyncAudioDecompress TempDecompress(SoundWave, 128, AudioDevice);
-				TempDecompress.StartSynchronousTask();
+	stream->Start();
+	precache_streams.Add(stream);
+}
 
-				const float timeEnded = GetWorld()->RealTimeSeconds * 1000;
+void UClusterObject::ClearVoiceCache()
+{
+	voice_cache->Empty();
+}
 
-				UE_LOG(LogTemp, Warning, TEXT("Finished de-compressing. It took %f ms to decompress the audio."), timeEnded - timeStarted);
-			}
+FVoiceCacheStats UClusterObject::GetVoiceCacheStats() const
+{
+	const FDppVoiceCache::FStats cache_stats = voice_cache->GetStats();
+
+	FVoiceCacheStats stats;
+	stats.bytes = cache_stats.bytes;
+	stats.budget_bytes = cache_stats.budget;
+	stats.sounds = cache_stats.entries;
+	stats.hits = cache_stats.hits;
+	stats.misses = cache_stats.misses;
+	stats.evictions = cache_stats.evictions;
+	return stats;
+}
 
-			SoundWave->DecompressionType = DecompressionType;
+FCacheMemoryStats UClusterObject::GetCacheMemoryStats(const bool deep) const
+{
+	return DppUE::MeasureCacheMemory(deep);
+}
 
-			// Because the data is done, let's start sending audio and get ourselves out of the game thread.
-			CommenceAudioSend(v, SoundWave);
-			
-			return true;
-		});
+void UClusterObject::TickCacheStats(const float DeltaTime)
+{
+	if(cache_stats_interval_seconds <= 0.0f || !IsBotRunning())
+	{
+		cache_stats_elapsed = 0.0f;
+		return;
 	}
 
-	CommenceAudioSend(v, SoundWave);
+	cache_stats_elapsed += DeltaTime;
 
-	return true; 
-	
+	if(cache_stats_elapsed < cache_stats_interval_seconds || cache_stats_in_flight)
+		return;
+
+	cache_stats_elapsed = 0.0f;
+	cache_stats_in_flight = true;
+
+	// Walking the caches takes a while on big bots, so it's done on a worker and only the result comes back.
+	Async(EAsyncExecution::ThreadPool, [weak_this = TWeakObjectPtr<UClusterObject>(this), deep = cache_stats_deep]
+	{
+		FCacheMemoryStats stats = DppUE::MeasureCacheMemory(deep);
+
+		AsyncTask(ENamedThreads::Type::GameThread, [weak_this, stats = MoveTemp(stats)]
+		{
+			UClusterObject* cluster_object = weak_this.Get();
+
+			if(!cluster_object)
+				return;
+
+			cluster_object->cache_stats_in_flight = false;
+			cluster_object->OnCacheMemoryStats.Broadcast(stats);
+		});
+	});
+}
+
+void UClusterObject::StopVoiceStreams()
+{
+	for(const TPair<FDiscordSnowflake, TSharedPtr<FDppVoiceStream>>& stream : voice_streams)
+		stream.Value->StopAndWait();
+
+	voice_streams.Empty();
+
+	for(const TSharedPtr<FDppVoiceStream>& stream : precache_streams)
+		stream->StopAndWait();
+
+	precache_streams.Empty();
 }
 
 void UClusterObject::SetBotStatus(FStatus status)
 {
+	if(!clusterRef)
+	{
+		DPPUE_WARN_FSTR("The bot isn't running, so its status can't be set.");
+		return;
+	}
+
 	clusterRef->set_presence(dpp::presence(status.status_type_to_status(), status.activity_type_to_status(), status.status_to_string()));
 }
 
 void UClusterObject::SendMessageToChannel(FDiscordMessage message, FOnMessageSent messageCallback)
 {
-	const dpp::message msg{GenerateDPPMessage(message)};
-	
-	clusterRef->message_create(msg, [&messageCallback](const dpp::confirmation_callback_t& callback)
+	if(!clusterRef)
+	{
+		DPPUE_WARN_FSTR("The bot isn't running, so the message can't be sent.");
+		bool executed = messageCallback.ExecuteIfBound(false);
+		return;
+	}
+
+	// Messages with an attachment take longer to build, so everything goes through the channel's queue to keep them in order.
+	const uint64 channel_id = message.channel_id.to_snowflake();
+	const TSharedRef<FChannelSend> send = MakeShared<FChannelSend>();
+	send->callback = messageCallback;
+	channel_sends.FindOrAdd(channel_id).Add(send);
+
+	GenerateDPPMessageAsync(message, [this, channel_id, send](dpp::message&& msg)
 	{
-		DPP_LOG_FSTR("Message create callback!");
-		// Promoted to variable to silence IDEs.
-		bool executed = messageCallback.ExecuteIfBound(callback.is_error());
+		send->msg.Emplace(MoveTemp(msg));
+		FlushChannelSends(channel_id);
 	});
 }
 
-void UClusterObject::CommenceAudioSend(const dpp::voiceconn* Voiceconn, const USoundWave* SoundWave)
+void UClusterObject::FlushChannelSends(const uint64 channel_id)
 {
-	// RawPCMData "claims" 16 bit and proceeds to give us 8 bit.
-	// This is the silliest thing I've ever read, so we have to do reinterpret_cast.
-	Voiceconn->voiceclient->send_audio_raw(reinterpret_cast<uint16_t*>(SoundWave->RawPCMData), SoundWave->RawPCMDataSize);
+	// DPP sends requests to the same route in the order they're made, so sending in order here is enough.
+	while(TArray<TSharedRef<FChannelSend>>* sends = channel_sends.Find(channel_id))
+	{
+		if(!(*sends)[0]->msg.IsSet())
+			break;
+
+		// Taken off the queue before sending, as the callback can send more messages and change it.
+		const TSharedRef<FChannelSend> send = (*sends)[0];
+		sends->RemoveAt(0);
+
+		if(sends->IsEmpty())
+			channel_sends.Remove(channel_id);
+
+		if(!clusterRef)
+		{
+			bool executed = send->callback.ExecuteIfBound(false);
+			continue;
+		}
+
+		clusterRef->message_create(send->msg.GetValue(), [weak_this = TWeakObjectPtr<UClusterObject>(this), messageCallback = send->callback](const dpp::confirmation_callback_t& callback)
+		{
+			DPP_LOG_FSTR("Message create callback!");
+
+			// This is called from a REST thread, Blueprints need it on the GameThread.
+			AsyncTask(ENamedThreads::Type::GameThread, [weak_this, messageCallback, success = !callback.is_error()]
+			{
+				if(!weak_this.IsValid())
+					return;
+
+				// Promoted to variable to silence IDEs.
+				bool executed = messageCallback.ExecuteIfBound(success);
+			});
+		});
+	}
 }
 
-dpp::message UClusterObject::GenerateDPPMessage(const FDiscordMessage& discord_message)
+void UClusterObject::DeleteMessage(FDiscordSnowflake ChannelID, FDiscordSnowflake MessageID, FOnMessageDeleted deleteCallback)
 {
-	dpp::message msg(discord_message.channel_id.string_id_to_snowflake(), TCHAR_TO_UTF8(*discord_message.content));
-	
-	if(!discord_message.image_url.IsEmpty())
-	{
-		/*
-		 * If you get an error here from calling this in an event,
-		 * your file may be too big for your internet (and possibly storage drive) to load the file in time!
-		 * Look to use the "thinking" event if this keeps happening, or try to compress your image more!
-		 */
-		try {
-			std::ifstream ifs(StringCast<ANSICHAR>(*discord_message.image_url).Get(), std::ios::binary);
-			msg.add_file("image.png", std::string(std::istreambuf_iterator(ifs), std::istreambuf_iterator<char>()));
-		}
-		catch (const std::exception& e) {
-			UE_LOG(LogTemp, Display, TEXT("[DPP-UE]: Failed to get data from image file. %s"), *FString(e.what()));
-		}
+	rest_coalescer->message_delete(MessageID.to_snowflake(), ChannelID.to_snowflake(), [weak_this = TWeakObjectPtr<UClusterObject>(this), deleteCallback](const dpp::confirmation_callback_t& callback)
+	{
+		// Usually called from a REST thread, Blueprints need it on the GameThread.
+		AsyncTask(ENamedThreads::Type::GameThread, [weak_this, deleteCallback, success = !callback.is_error()]
+		{
+			if(!weak_this.IsValid())
+				return;
+
+			// Promoted to variable to silence IDEs.
+			bool executed = deleteCallback.ExecuteIfBound(success);
+		});
+	});
+}
+
+TSharedPtr<FDppRestCoalescer, ESPMode::ThreadSafe> UClusterObject::GetRestCoalescer() const
+{
+	return rest_coalescer;
+}
+
+void UClusterObject::GenerateDPPMessageAsync(const FDiscordMessage& discord_message, TUniqueFunction<void(dpp::message&&)>&& on_generated)
+{
+	dpp::message msg{GenerateDPPMessage(discord_message)};
+
+	if(discord_message.image_url.IsEmpty())
+	{
+		on_generated(MoveTemp(msg));
+		return;
 	}
+
+	attachment_cache->SetBudget(static_cast<int64>(attachment_cache_budget_mb) * 1024 * 1024);
+
+	// Big files used to stall the frame (and time out interactions) while loading, so they're loaded on a worker now.
+	attachment_cache->Load(discord_message.image_url, [weak_this = TWeakObjectPtr<UClusterObject>(this), msg = MoveTemp(msg), on_generated = MoveTemp(on_generated)](FDppAttachmentCache::FContent content) mutable
+	{
+		// add_file copies the whole file into the message, so that happens here on the worker too.
+		if(content)
+			msg.add_file("image.png", *content);
+
+		AsyncTask(ENamedThreads::Type::GameThread, [weak_this, msg = MoveTemp(msg), on_generated = MoveTemp(on_generated)]() mutable
+		{
+			if(!weak_this.IsValid())
+				return;
+
+			on_generated(MoveTemp(msg));
+		});
+	});
+}
+
+dpp::message UClusterObject::GenerateDPPMessage(const FDiscordMessage& discord_message)
+{
+	// The constructor copies the content, so converting into the scratch buffer saves an allocation.
+	dpp::message msg(discord_message.channel_id.to_snowflake(), DppUE::ToUtf8Scratch(discord_message.content));
 	
-	for(auto row : discord_message.component_rows)
+	for(const FMessageComponentRow& row : discord_message.component_rows)
 	{
 		dpp::component row_comp;
 		
-		for(auto fmsg_comp : row.components)
+		for(const FMessageComponent& fmsg_comp : row.components)
 		{
 			dpp::component msg_comp;
-			msg_comp.set_label(std::string(TCHAR_TO_UTF8(*fmsg_comp.component_label)))
-			.set_style(dpp::cos_primary)
-			.set_id(std::string(TCHAR_TO_UTF8(*fmsg_comp.component_id)));
+			// Each setter copies out of the scratch buffer before it gets reused, so keep these as separate calls.
+			msg_comp.set_label(DppUE::ToUtf8Scratch(fmsg_comp.component_label));
+			msg_comp.set_id(DppUE::ToUtf8Scratch(fmsg_comp.component_id));
+			msg_comp.set_style(dpp::cos_primary);
 
 			msg_comp.set_disabled(!fmsg_comp.component_enabled);
 
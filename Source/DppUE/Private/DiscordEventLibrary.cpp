@@ -0,0 +1,87 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DiscordEventLibrary.h"
+
+FSlashcommand_Event UDiscordEventLibrary::MakeSlashcommandEvent(const FString& command_name, const FString& issuing_user, const FDiscordSnowflake issuing_user_id)
+{
+	FSlashcommand_Event event;
+	event.command_name = DppUE::ToUtf8(command_name);
+	event.issuing_user = DppUE::ToUtf8(issuing_user);
+	event.issuing_user_id = issuing_user_id;
+	return event;
+}
+
+void UDiscordEventLibrary::BreakSlashcommandEvent(const FSlashcommand_Event& event, FString& command_name, FString& issuing_user, FDiscordSnowflake& issuing_user_id)
+{
+	command_name = event.command_name.to_fstring();
+	issuing_user = event.issuing_user.to_fstring();
+	issuing_user_id = event.issuing_user_id;
+}
+
+FString UDiscordEventLibrary::GetCommandName(const FSlashcommand_Event& event)
+{
+	return event.command_name.to_fstring();
+}
+
+FString UDiscordEventLibrary::GetCommandIssuingUser(const FSlashcommand_Event& event)
+{
+	return event.issuing_user.to_fstring();
+}
+
+FButtonClick_Event UDiscordEventLibrary::MakeButtonClickEvent(const FString& custom_id, const FString& issuing_user, const FDiscordSnowflake issuing_user_id)
+{
+	FButtonClick_Event event;
+	event.custom_id = DppUE::ToUtf8(custom_id);
+	event.issuing_user = DppUE::ToUtf8(issuing_user);
+	event.issuing_user_id = issuing_user_id;
+	return event;
+}
+
+void UDiscordEventLibrary::BreakButtonClickEvent(const FButtonClick_Event& event, FString& custom_id, FString& issuing_user, FDiscordSnowflake& issuing_user_id)
+{
+	custom_id = event.custom_id.to_fstring();
+	issuing_user = event.issuing_user.to_fstring();
+	issuing_user_id = event.issuing_user_id;
+}
+
+FString UDiscordEventLibrary::GetButtonCustomId(const FButtonClick_Event& event)
+{
+	return event.custom_id.to_fstring();
+}
+
+FString UDiscordEventLibrary::GetButtonIssuingUser(const FButtonClick_Event& event)
+{
+	return event.issuing_user.to_fstring();
+}
+
+FMessage_event UDiscordEventLibrary::MakeMessageEvent(const FDiscordMessage& message, const FString& message_creator, const FDiscordSnowflake message_creator_id)
+{
+	FMessage_event event;
+	event.message = message;
+	event.content = DppUE::ToUtf8(message.content);
+	event.message_creator = DppUE::ToUtf8(message_creator);
+	event.message_creator_id = message_creator_id;
+	return event;
+}
+
+void UDiscordEventLibrary::BreakMessageEvent(const FMessage_event& event, FDiscordMessage& message, FString& message_creator, FDiscordSnowflake& message_creator_id)
+{
+	message = event.message;
+
+	// Events made in C++ might only have set the UTF-8 content.
+	if(message.content.IsEmpty())
+		message.content = event.content.to_fstring();
+	message_creator = event.message_creator.to_fstring();
+	message_creator_id = event.message_creator_id;
+}
+
+FString UDiscordEventLibrary::GetMessageContent(const FMessage_event& event)
+{
+	return event.content.to_fstring();
+}
+
+FString UDiscordEventLibrary::GetMessageCreator(const FMessage_event& event)
+{
+	return event.message_creator.to_fstring();
+}
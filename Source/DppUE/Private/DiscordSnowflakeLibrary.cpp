@@ -0,0 +1,39 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DiscordSnowflakeLibrary.h"
+
+FDiscordSnowflake UDiscordSnowflakeLibrary::MakeSnowflake(const FString& snowflake_id)
+{
+	return FDiscordSnowflake::from_fstring(snowflake_id);
+}
+
+void UDiscordSnowflakeLibrary::BreakSnowflake(const FDiscordSnowflake& snowflake, FString& snowflake_id)
+{
+	snowflake_id = snowflake.to_fstring();
+}
+
+FString UDiscordSnowflakeLibrary::Conv_SnowflakeToString(const FDiscordSnowflake& snowflake)
+{
+	return snowflake.to_fstring();
+}
+
+FDiscordSnowflake UDiscordSnowflakeLibrary::Conv_StringToSnowflake(const FString& snowflake_id)
+{
+	return FDiscordSnowflake::from_fstring(snowflake_id);
+}
+
+bool UDiscordSnowflakeLibrary::EqualEqual_SnowflakeSnowflake(const FDiscordSnowflake& a, const FDiscordSnowflake& b)
+{
+	return a == b;
+}
+
+bool UDiscordSnowflakeLibrary::NotEqual_SnowflakeSnowflake(const FDiscordSnowflake& a, const FDiscordSnowflake& b)
+{
+	return a != b;
+}
+
+bool UDiscordSnowflakeLibrary::IsValidSnowflake(const FDiscordSnowflake& snowflake)
+{
+	return !snowflake.is_empty();
+}
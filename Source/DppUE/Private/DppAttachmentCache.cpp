@@ -0,0 +1,110 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DppAttachmentCache.h"
+
+#include "Async/Async.h"
+#include "HAL/PlatformFileManager.h"
+
+FDppAttachmentCache::FDppAttachmentCache(const int64 budget_bytes) : contents(budget_bytes)
+{
+	// Evictions only happen inside contents, which is always used with the lock held.
+	contents.SetOnEvicted([this](const FSHAHash& hash)
+	{
+		for(auto it = index.CreateIterator(); it; ++it)
+		{
+			if(it.Value().hash == hash)
+				it.RemoveCurrent();
+		}
+	});
+}
+
+void FDppAttachmentCache::Load(const FString& path, TUniqueFunction<void(FContent)>&& on_loaded)
+{
+	Async(EAsyncExecution::ThreadPool, [cache = AsShared(), path, on_loaded = MoveTemp(on_loaded)]() mutable
+	{
+		on_loaded(cache->LoadBlocking(path));
+	});
+}
+
+void FDppAttachmentCache::SetBudget(const int64 budget_bytes)
+{
+	FScopeLock scope_lock(&lock);
+	contents.SetBudget(budget_bytes);
+}
+
+void FDppAttachmentCache::Empty()
+{
+	FScopeLock scope_lock(&lock);
+	contents.Empty();
+	index.Empty();
+}
+
+FDppAttachmentCache::FContent FDppAttachmentCache::LoadBlocking(const FString& path)
+{
+	IPlatformFile& platform_file = FPlatformFileManager::Get().GetPlatformFile();
+	const FFileStatData stat_data = platform_file.GetStatData(*path);
+
+	if(!stat_data.bIsValid || stat_data.bIsDirectory)
+	{
+		UE_LOG(LogTemp, Display, TEXT("[DPP-UE]: Failed to get data from image file. %s does not exist."), *path);
+		return nullptr;
+	}
+
+	{
+		FScopeLock scope_lock(&lock);
+
+		const FIndexedFile* indexed = index.Find(path);
+
+		if(indexed && indexed->size == stat_data.FileSize && indexed->modification_time == stat_data.ModificationTime)
+		{
+			if(const FContent* content = contents.Find(indexed->hash))
+				return *content;
+		}
+	}
+
+	TUniquePtr<IFileHandle> handle(platform_file.OpenRead(*path));
+
+	if(!handle)
+	{
+		UE_LOG(LogTemp, Display, TEXT("[DPP-UE]: Failed to get data from image file. %s could not be opened."), *path);
+		return nullptr;
+	}
+
+	const int64 size = handle->Size();
+	TSharedRef<std::string, ESPMode::ThreadSafe> content = MakeShared<std::string, ESPMode::ThreadSafe>();
+	content->resize(size);
+
+	if(size > 0 && !handle->Read(reinterpret_cast<uint8*>(content->data()), size))
+	{
+		UE_LOG(LogTemp, Display, TEXT("[DPP-UE]: Failed to get data from image file. %s could not be read."), *path);
+		return nullptr;
+	}
+
+	FSHAHash hash;
+	FSHA1::HashBuffer(content->data(), content->size(), hash.Hash);
+
+	FScopeLock scope_lock(&lock);
+
+	// The same bytes are already cached under another path, share them instead of keeping a second copy.
+	FContent result = content;
+
+	if(const FContent* existing = contents.Find(hash))
+	{
+		result = *existing;
+	}
+	else if(!contents.Add(hash, FContent(content), size))
+	{
+		// Too big to cache, so there's nothing for the path to point at.
+		index.Remove(path);
+		return content;
+	}
+
+	// Added after the content, as adding it can evict and the eviction clears out index entries.
+	FIndexedFile& indexed = index.FindOrAdd(path);
+	indexed.size = stat_data.FileSize;
+	indexed.modification_time = stat_data.ModificationTime;
+	indexed.hash = hash;
+
+	return result;
+}
@@ -0,0 +1,64 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include <string>
+
+#include "CoreMinimal.h"
+#include "Misc/SecureHash.h"
+#include "Templates/Function.h"
+#include "DppLruCache.h"
+
+/**
+ * @brief Loads message attachments off the GameThread, and keeps recently sent ones in memory.
+ *
+ * Files are read straight into the std::string that DPP takes, with no intermediate buffer.
+ * The content is cached by its SHA-1, so the same file under several paths (or copied around) is only kept once.
+ * Finding a file's hash without reading it goes through an index of path, size and modification time,
+ * so an edited file is read and hashed again rather than sent stale.
+ * The least recently used content is evicted once the cache goes over its memory budget.
+ */
+class FDppAttachmentCache : public TSharedFromThis<FDppAttachmentCache, ESPMode::ThreadSafe>
+{
+public:
+
+	using FContent = TSharedPtr<const std::string, ESPMode::ThreadSafe>;
+
+	explicit FDppAttachmentCache(int64 budget_bytes);
+
+	/**
+	 * @brief Load a file on a worker thread.
+	 * @param on_loaded Called on the worker thread with the file's content, or nullptr if it couldn't be read.
+	 */
+	void Load(const FString& path, TUniqueFunction<void(FContent)>&& on_loaded);
+
+	void SetBudget(int64 budget_bytes);
+
+	void Empty();
+
+private:
+
+	/**
+	 * @brief Stat, find or read the file. Runs on the worker thread.
+	 */
+	FContent LoadBlocking(const FString& path);
+
+	/**
+	 * @brief What a path held the last time it was read. Stale as soon as the size or modification time changes.
+	 */
+	struct FIndexedFile
+	{
+		int64 size = 0;
+		FDateTime modification_time;
+		FSHAHash hash;
+	};
+
+	FCriticalSection lock;
+
+	/**
+	 * @brief One entry per path whose content is cached. Entries go when their content is evicted, so this never outgrows the cache.
+	 */
+	TMap<FString, FIndexedFile> index;
+
+	TDppLruCache<FSHAHash, FContent> contents;
+};
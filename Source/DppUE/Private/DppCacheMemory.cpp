@@ -0,0 +1,195 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DppCacheMemory.h"
+
+#include <shared_mutex>
+#include <vector>
+
+namespace
+{
+	/**
+	 * @brief Heap memory owned by a string. Short strings live inside the object, so they count for nothing extra.
+	 */
+	int64 StringBytes(const std::string& string)
+	{
+		static const size_t inline_capacity = std::string().capacity();
+		return string.capacity() > inline_capacity ? string.capacity() + 1 : 0;
+	}
+
+	template<typename T>
+	int64 VectorBytes(const std::vector<T>& vector)
+	{
+		return vector.capacity() * sizeof(T);
+	}
+
+	/**
+	 * @brief The bucket array and one node per entry, each node being the value plus its next pointer.
+	 */
+	template<typename MapType>
+	int64 HashMapBytes(const MapType& map)
+	{
+		return map.bucket_count() * sizeof(void*) + map.size() * (sizeof(typename MapType::value_type) + sizeof(void*));
+	}
+
+	/**
+	 * @brief One red-black tree node per entry, the value plus three pointers and a colour.
+	 */
+	template<typename MapType>
+	int64 TreeMapBytes(const MapType& map)
+	{
+		return map.size() * (sizeof(typename MapType::value_type) + 4 * sizeof(void*));
+	}
+
+	int64 ObjectBytes(const dpp::user& user)
+	{
+		return sizeof(dpp::user) + StringBytes(user.username) + StringBytes(user.global_name);
+	}
+
+	int64 ObjectBytes(const dpp::guild& guild)
+	{
+		// Each member's nickname and role list are left out, see MeasureCacheMemory.
+		return sizeof(dpp::guild) + StringBytes(guild.name) + StringBytes(guild.description) + StringBytes(guild.vanity_url_code)
+			+ VectorBytes(guild.roles) + VectorBytes(guild.channels) + VectorBytes(guild.threads) + VectorBytes(guild.emojis)
+			+ StringBytes(guild.welcome_screen.description) + VectorBytes(guild.welcome_screen.welcome_channels)
+			+ TreeMapBytes(guild.voice_members) + HashMapBytes(guild.members);
+	}
+
+	int64 ObjectBytes(const dpp::channel& channel)
+	{
+		return sizeof(dpp::channel) + StringBytes(channel.name) + StringBytes(channel.topic) + StringBytes(channel.rtc_region)
+			+ VectorBytes(channel.recipients) + VectorBytes(channel.permission_overwrites) + VectorBytes(channel.available_tags);
+	}
+
+	int64 ObjectBytes(const dpp::role& role)
+	{
+		return sizeof(dpp::role) + StringBytes(role.name) + StringBytes(role.unicode_emoji);
+	}
+
+	int64 ObjectBytes(const dpp::emoji& emoji)
+	{
+		return sizeof(dpp::emoji) + StringBytes(emoji.name) + StringBytes(emoji.image_data);
+	}
+
+	/**
+	 * @brief Measure a cache from what its lock protects: the container, and sizeof for every object in it.
+	 */
+	template<typename T>
+	FCacheMemoryUsage MeasureCacheShallow(dpp::cache<T>* cache)
+	{
+		FCacheMemoryUsage usage;
+
+		if(!cache)
+			return usage;
+
+		std::shared_lock lock(cache->get_mutex());
+		const auto& container = cache->get_container();
+
+		usage.count = container.size();
+		usage.bytes = HashMapBytes(container) + usage.count * sizeof(T);
+
+		return usage;
+	}
+
+	/**
+	 * @brief Measure every object in a cache. on_object is called with each object and its size.
+	 *
+	 * Only the pointers are copied while the cache is locked, the objects are walked after, so the shards are never held up by the walk.
+	 * That's safe because D++ never frees a removed object straight away: it sits in the deletion queue for 60 seconds first.
+	 * @warning The objects themselves aren't protected by the lock, see MeasureCacheMemory.
+	 */
+	template<typename T, typename FunctionType>
+	FCacheMemoryUsage MeasureCache(dpp::cache<T>* cache, FunctionType&& on_object)
+	{
+		FCacheMemoryUsage usage;
+
+		if(!cache)
+			return usage;
+
+		std::vector<const T*> objects;
+
+		{
+			std::shared_lock lock(cache->get_mutex());
+			const auto& container = cache->get_container();
+
+			usage.count = container.size();
+			usage.bytes = HashMapBytes(container);
+
+			objects.reserve(container.size());
+
+			for(const auto& [id, object] : container)
+			{
+				if(object)
+					objects.push_back(object);
+			}
+		}
+
+		for(const T* object : objects)
+		{
+			const int64 bytes = ObjectBytes(*object);
+			usage.bytes += bytes;
+			on_object(*object, bytes);
+		}
+
+		return usage;
+	}
+}
+
+FCacheMemoryStats DppUE::MeasureCacheMemory(const bool deep)
+{
+	FCacheMemoryStats stats;
+
+	if(!deep)
+	{
+		stats.users = MeasureCacheShallow(dpp::get_user_cache());
+		stats.guilds = MeasureCacheShallow(dpp::get_guild_cache());
+		stats.channels = MeasureCacheShallow(dpp::get_channel_cache());
+		stats.roles = MeasureCacheShallow(dpp::get_role_cache());
+		stats.emojis = MeasureCacheShallow(dpp::get_emoji_cache());
+
+		stats.total_bytes = stats.users.bytes + stats.guilds.bytes + stats.channels.bytes + stats.roles.bytes + stats.emojis.bytes;
+		return stats;
+	}
+
+	// Channels and roles are cached on their own, but they're attributed to their guild in the breakdown too.
+	TMap<FDiscordSnowflake, int32> guild_index;
+
+	stats.guilds = MeasureCache(dpp::get_guild_cache(), [&stats, &guild_index](const dpp::guild& guild, const int64 bytes)
+	{
+		FGuildMemoryUsage& guild_usage = stats.guild_breakdown.AddDefaulted_GetRef();
+		guild_usage.guild_id = guild.id;
+		guild_usage.members = guild.members.size();
+		guild_usage.bytes = bytes;
+
+		guild_index.Add(guild.id, stats.guild_breakdown.Num() - 1);
+	});
+
+	auto attribute_to_guild = [&stats, &guild_index](const dpp::snowflake guild_id, const int64 bytes)
+	{
+		if(const int32* index = guild_index.Find(guild_id))
+			stats.guild_breakdown[*index].bytes += bytes;
+	};
+
+	stats.channels = MeasureCache(dpp::get_channel_cache(), [&attribute_to_guild](const dpp::channel& channel, const int64 bytes)
+	{
+		attribute_to_guild(channel.guild_id, bytes);
+	});
+
+	stats.roles = MeasureCache(dpp::get_role_cache(), [&attribute_to_guild](const dpp::role& role, const int64 bytes)
+	{
+		attribute_to_guild(role.guild_id, bytes);
+	});
+
+	stats.users = MeasureCache(dpp::get_user_cache(), [](const dpp::user&, int64) {});
+	stats.emojis = MeasureCache(dpp::get_emoji_cache(), [](const dpp::emoji&, int64) {});
+
+	stats.total_bytes = stats.users.bytes + stats.guilds.bytes + stats.channels.bytes + stats.roles.bytes + stats.emojis.bytes;
+
+	// Biggest first, that's what anyone looking at this wants to see.
+	stats.guild_breakdown.Sort([](const FGuildMemoryUsage& a, const FGuildMemoryUsage& b)
+	{
+		return a.bytes > b.bytes;
+	});
+
+	return stats;
+}
@@ -0,0 +1,24 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ClusterObject.h"
+
+namespace DppUE
+{
+	/**
+	 * @brief Estimate how much memory D++'s user, guild, channel, role and emoji caches use.
+	 *
+	 * D++'s caches are shared by every cluster in the process, so this covers every bot, not just one.
+	 *
+	 * By default, only what each cache's own shared lock protects is read: how many objects it holds and the container holding them.
+	 * Every object is counted at its sizeof, so heap strings, vectors and member maps are left out. This is safe from any thread.
+	 *
+	 * @param deep Also walk into every object (strings, vectors, member, role and channel lists) and fill in the per guild breakdown.
+	 * D++ updates objects in place from the shard threads without taking the cache's lock, so this reads them racily.
+	 * The numbers can be torn, so only use it for a rough picture, and never on a hot path.
+	 * Each cache is only locked while its object pointers are copied, not for the whole walk.
+	 */
+	FCacheMemoryStats MeasureCacheMemory(bool deep = false);
+}
@@ -0,0 +1,143 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * @brief A map with a memory budget, evicting the least recently used entries once it goes over.
+ *
+ * The size of every entry is given when it's added, so the values can be anything.
+ * Not thread safe, the caches using this keep it behind their own lock.
+ */
+template<typename KeyType, typename ValueType>
+class TDppLruCache
+{
+public:
+
+	explicit TDppLruCache(const int64 budget_bytes = 0) : budget(budget_bytes)
+	{
+	}
+
+	/**
+	 * @brief Find an entry, marking it as recently used.
+	 * @return The value, or nullptr if there's no entry. Only valid until the cache is next changed.
+	 */
+	const ValueType* Find(const KeyType& key)
+	{
+		FEntry* entry = entries.Find(key);
+
+		if(!entry)
+			return nullptr;
+
+		entry->last_used = ++use_counter;
+		return &entry->value;
+	}
+
+	/**
+	 * @brief Add or replace an entry, evicting others if the cache goes over budget.
+	 * @return False if the entry is bigger than the whole budget, in which case it isn't added.
+	 */
+	bool Add(const KeyType& key, ValueType&& value, const int64 size)
+	{
+		if(size > budget)
+			return false;
+
+		if(const FEntry* existing = entries.Find(key))
+			bytes -= existing->size;
+
+		FEntry& entry = entries.Add(key);
+		entry.value = MoveTemp(value);
+		entry.size = size;
+		entry.last_used = ++use_counter;
+		bytes += size;
+
+		EvictToBudget();
+		return true;
+	}
+
+	bool CanFit(const int64 size) const
+	{
+		return size <= budget;
+	}
+
+	/**
+	 * @brief Called with the key of every entry evicted for going over budget, so anything pointing at it can be dropped too.
+	 */
+	void SetOnEvicted(TFunction<void(const KeyType&)>&& on_evicted_callback)
+	{
+		on_evicted = MoveTemp(on_evicted_callback);
+	}
+
+	void SetBudget(const int64 budget_bytes)
+	{
+		budget = budget_bytes;
+		EvictToBudget();
+	}
+
+	void Empty()
+	{
+		entries.Empty();
+		bytes = 0;
+	}
+
+	int64 GetBytes() const
+	{
+		return bytes;
+	}
+
+	int64 GetBudget() const
+	{
+		return budget;
+	}
+
+	int32 Num() const
+	{
+		return entries.Num();
+	}
+
+	uint64 GetEvictions() const
+	{
+		return evictions;
+	}
+
+private:
+
+	void EvictToBudget()
+	{
+		// These caches only ever hold a handful of entries, so a scan for the oldest is cheaper than keeping a list in order.
+		while(bytes > budget && entries.Num() > 0)
+		{
+			const TPair<KeyType, FEntry>* oldest = nullptr;
+
+			for(const TPair<KeyType, FEntry>& entry : entries)
+			{
+				if(!oldest || entry.Value.last_used < oldest->Value.last_used)
+					oldest = &entry;
+			}
+
+			// Copied out first, removing by a reference into the map would read the key after it's gone.
+			const KeyType oldest_key = oldest->Key;
+			bytes -= oldest->Value.size;
+			entries.Remove(oldest_key);
+			++evictions;
+
+			if(on_evicted)
+				on_evicted(oldest_key);
+		}
+	}
+
+	struct FEntry
+	{
+		ValueType value;
+		int64 size = 0;
+		uint64 last_used = 0;
+	};
+
+	TMap<KeyType, FEntry> entries;
+	TFunction<void(const KeyType&)> on_evicted;
+	int64 bytes = 0;
+	int64 budget = 0;
+	uint64 use_counter = 0;
+	uint64 evictions = 0;
+};
@@ -0,0 +1,237 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DppReplyDeferrer.h"
+
+#include "HAL/Event.h"
+#include "HAL/RunnableThread.h"
+
+FDppPendingReply::FDppPendingReply(dpp::cluster* cluster, const uint32 cluster_generation, const dpp::snowflake interaction_id, std::string interaction_token, const bool ephemeral)
+	: cluster(cluster), cluster_generation(cluster_generation), interaction_id(interaction_id), interaction_token(MoveTemp(interaction_token)), ephemeral(ephemeral), received_seconds(FPlatformTime::Seconds())
+{
+}
+
+bool FDppPendingReply::Defer()
+{
+	FScopeLock scope_lock(&lock);
+
+	if(state != EState::Waiting)
+		return false;
+
+	state = EState::Deferring;
+
+	dpp::message thinking;
+
+	if(ephemeral)
+		thinking.set_flags(dpp::m_ephemeral);
+
+	cluster->interaction_response_create(interaction_id, interaction_token, dpp::interaction_response(dpp::ir_deferred_channel_message_with_source, thinking),
+		[self = AsShared()](const dpp::confirmation_callback_t& callback)
+		{
+			FScopeLock callback_lock(&self->lock);
+
+			if(callback.is_error())
+			{
+				// Too late, or Discord refused it. Either way, there's nothing an edit could go to.
+				UE_LOG(LogTemp, Warning, TEXT("[DPP-UE]: Failed to defer an interaction reply. %s"), *FString(callback.get_error().message.c_str()));
+				self->state = EState::Replied;
+				self->waiting_edit.Reset();
+				return;
+			}
+
+			self->state = EState::Deferred;
+
+			if(self->waiting_edit.IsSet())
+			{
+				self->SendEdit(*self->cluster, MoveTemp(self->waiting_edit.GetValue()));
+				self->waiting_edit.Reset();
+			}
+		});
+
+	return true;
+}
+
+void FDppPendingReply::Reply(dpp::cluster& current_cluster, dpp::message&& msg)
+{
+	FScopeLock scope_lock(&lock);
+
+	switch(state)
+	{
+	case EState::Waiting:
+		state = EState::Replied;
+		current_cluster.interaction_response_create(interaction_id, interaction_token, dpp::interaction_response(dpp::ir_channel_message_with_source, msg));
+		break;
+	case EState::Deferring:
+		// Discord hasn't acknowledged the "thinking" response yet, the edit goes out once it has.
+		waiting_edit.Emplace(MoveTemp(msg));
+		break;
+	case EState::Deferred:
+		SendEdit(current_cluster, MoveTemp(msg));
+		break;
+	case EState::Replied:
+		break;
+	}
+}
+
+double FDppPendingReply::GetSecondsWaiting() const
+{
+	return FPlatformTime::Seconds() - received_seconds;
+}
+
+void FDppPendingReply::SendEdit(dpp::cluster& send_cluster, dpp::message&& msg) const
+{
+	send_cluster.interaction_response_edit(interaction_token, msg);
+}
+
+FDppReplyDeferrer::FDppReplyDeferrer()
+{
+	wake_event = FPlatformProcess::GetSynchEventFromPool(false);
+}
+
+FDppReplyDeferrer::~FDppReplyDeferrer()
+{
+	StopAndWait();
+
+	FPlatformProcess::ReturnSynchEventToPool(wake_event);
+	wake_event = nullptr;
+}
+
+void FDppReplyDeferrer::Start(const uint32 cluster_generation)
+{
+	StopAndWait();
+
+	{
+		FScopeLock scope_lock(&lock);
+		running = true;
+		tracked_generation = cluster_generation;
+	}
+
+	stopping = false;
+	thread = FRunnableThread::Create(this, TEXT("DppReplyDeferrer"), 0, TPri_AboveNormal);
+}
+
+void FDppReplyDeferrer::StopAndWait()
+{
+	{
+		FScopeLock scope_lock(&lock);
+		running = false;
+	}
+
+	if(thread)
+	{
+		Stop();
+		thread->WaitForCompletion();
+		delete thread;
+		thread = nullptr;
+	}
+
+	FScopeLock scope_lock(&lock);
+	deadlines.Empty();
+}
+
+void FDppReplyDeferrer::SetBudget(const double seconds)
+{
+	budget = seconds;
+}
+
+void FDppReplyDeferrer::SetEphemeral(const bool ephemeral)
+{
+	defer_ephemeral = ephemeral;
+}
+
+TSharedPtr<FDppPendingReply, ESPMode::ThreadSafe> FDppReplyDeferrer::MakePendingReply(dpp::cluster* cluster, const uint32 cluster_generation, const dpp::snowflake interaction_id, const std::string& interaction_token) const
+{
+	return MakeShared<FDppPendingReply, ESPMode::ThreadSafe>(cluster, cluster_generation, interaction_id, interaction_token, defer_ephemeral.load());
+}
+
+void FDppReplyDeferrer::Track(const TSharedPtr<FDppPendingReply, ESPMode::ThreadSafe>& pending_reply)
+{
+	const double budget_seconds = budget;
+
+	if(budget_seconds < 0.0)
+		return;
+
+	{
+		FScopeLock scope_lock(&lock);
+
+		if(!running || pending_reply->GetClusterGeneration() != tracked_generation)
+			return;
+
+		// The deadline counts from when the interaction arrived, not from now, as that's what Discord counts from.
+		deadlines.HeapPush(FDeadline{FPlatformTime::Seconds() + budget_seconds - pending_reply->GetSecondsWaiting(), pending_reply});
+	}
+
+	wake_event->Trigger();
+}
+
+void FDppReplyDeferrer::Reply(dpp::cluster& current_cluster, FDppPendingReply& pending_reply, dpp::message&& msg)
+{
+	const double latency = pending_reply.GetSecondsWaiting();
+
+	pending_reply.Reply(current_cluster, MoveTemp(msg));
+
+	++replies;
+	total_latency += latency;
+	last_latency = latency;
+	max_latency = FMath::Max(max_latency, latency);
+}
+
+FDppReplyDeferrer::FStats FDppReplyDeferrer::GetStats() const
+{
+	FStats stats;
+	stats.replies = replies;
+	stats.deferred = deferred;
+	stats.last_latency = last_latency;
+	stats.average_latency = replies > 0 ? total_latency / replies : 0.0;
+	stats.max_latency = max_latency;
+	return stats;
+}
+
+uint32 FDppReplyDeferrer::Run()
+{
+	while(!stopping)
+	{
+		TSharedPtr<FDppPendingReply, ESPMode::ThreadSafe> due;
+		uint32 wait_ms = MAX_uint32;
+
+		{
+			FScopeLock scope_lock(&lock);
+
+			if(deadlines.Num() > 0)
+			{
+				const double remaining = deadlines.HeapTop().seconds - FPlatformTime::Seconds();
+
+				if(remaining <= 0.0)
+				{
+					FDeadline deadline;
+					deadlines.HeapPop(deadline, false);
+					due = MoveTemp(deadline.pending_reply);
+				}
+				else
+				{
+					wait_ms = FMath::Max(1u, static_cast<uint32>(FMath::CeilToInt(remaining * 1000.0)));
+				}
+			}
+		}
+
+		if(due)
+		{
+			// Replies that already went out are just dropped here.
+			if(due->Defer())
+				++deferred;
+
+			continue;
+		}
+
+		// Woken early whenever a new interaction comes in, in case its deadline is the earliest.
+		wake_event->Wait(wait_ms);
+	}
+
+	return 0;
+}
+
+void FDppReplyDeferrer::Stop()
+{
+	stopping = true;
+	wake_event->Trigger();
+}
@@ -0,0 +1,203 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include <atomic>
+#include <string>
+
+#include "CoreMinimal.h"
+#include "HAL/Runnable.h"
+
+THIRD_PARTY_INCLUDES_START
+#include <dpp/dpp.h>
+THIRD_PARTY_INCLUDES_END
+
+class FEvent;
+class FRunnableThread;
+
+/**
+ * @brief An interaction waiting for its reply from the GameThread.
+ *
+ * Whichever comes first wins: the GameThread replying, or the deferrer sending a "thinking" response.
+ * If the interaction was deferred, the reply is sent as an edit of the original response instead.
+ *
+ * The cluster given here is only used by the deferrer, which is stopped before that cluster is deleted.
+ * The GameThread replies through whichever cluster is current, after checking the reply is from that cluster's generation.
+ */
+class FDppPendingReply : public TSharedFromThis<FDppPendingReply, ESPMode::ThreadSafe>
+{
+public:
+
+	FDppPendingReply(dpp::cluster* cluster, uint32 cluster_generation, dpp::snowflake interaction_id, std::string interaction_token, bool ephemeral);
+
+	/**
+	 * @brief Send a "thinking" response, unless the interaction has already been replied to. Called from the deferrer thread.
+	 * @return True if the interaction got deferred.
+	 */
+	bool Defer();
+
+	/**
+	 * @brief Reply to the interaction, or edit the deferred response. Called from the GameThread.
+	 * @param current_cluster The cluster the GameThread currently owns. Must be the one this reply was tracked from, see GetClusterGeneration.
+	 */
+	void Reply(dpp::cluster& current_cluster, dpp::message&& msg);
+
+	/**
+	 * @brief The generation of the cluster the interaction came from, see UClusterObject::cluster_generation.
+	 */
+	uint32 GetClusterGeneration() const
+	{
+		return cluster_generation;
+	}
+
+	/**
+	 * @brief Seconds since the interaction arrived from Discord.
+	 */
+	double GetSecondsWaiting() const;
+
+private:
+
+	enum class EState : uint8
+	{
+		Waiting,
+		Replied,
+		Deferring,
+		Deferred,
+	};
+
+	/**
+	 * @brief Send the reply as an edit of the deferred response. Expects the lock to be held.
+	 */
+	void SendEdit(dpp::cluster& send_cluster, dpp::message&& msg) const;
+
+	FCriticalSection lock;
+	EState state = EState::Waiting;
+
+	/**
+	 * @brief A reply that arrived before Discord acknowledged the deferral. Editing before then would fail.
+	 */
+	TOptional<dpp::message> waiting_edit;
+
+	/**
+	 * @brief Only used by Defer and its acknowledgement, both of which run while the cluster is alive.
+	 */
+	dpp::cluster* cluster;
+	uint32 cluster_generation;
+	dpp::snowflake interaction_id;
+	std::string interaction_token;
+	bool ephemeral;
+	double received_seconds;
+};
+
+/**
+ * @brief Defers interactions that the GameThread hasn't replied to in time.
+ *
+ * Discord drops interactions that aren't answered within 3 seconds, and the GameThread can easily take
+ * longer than that under load. Interactions are tracked as they arrive, and once the budget runs out this
+ * thread sends a "thinking" response so the GameThread can reply (by editing it) whenever it gets there.
+ *
+ * Must be stopped before the cluster it defers through is deleted.
+ */
+class FDppReplyDeferrer : public FRunnable
+{
+public:
+
+	FDppReplyDeferrer();
+	virtual ~FDppReplyDeferrer() override;
+
+	/**
+	 * @brief Start deferring interactions from the given cluster generation.
+	 * Older clusters can still be shutting down after a restart, and anything they send is left alone rather than deferred through a cluster that's on its way out.
+	 */
+	void Start(uint32 cluster_generation);
+
+	/**
+	 * @brief Stop the thread and wait for it. Anything still being tracked is forgotten.
+	 */
+	void StopAndWait();
+
+	/**
+	 * @brief How long the GameThread gets before an interaction is deferred. Less than zero never defers.
+	 */
+	void SetBudget(double seconds);
+
+	/**
+	 * @brief Should "thinking" responses only be shown to the user who ran the command? The reply that edits it will be too.
+	 */
+	void SetEphemeral(bool ephemeral);
+
+	/**
+	 * @brief Make the reply to hand to the GameThread, as soon as the interaction arrives. Called from the shard threads.
+	 * @note Nothing gets deferred until it's passed to Track, so an interaction that never reaches the GameThread can't be left "thinking".
+	 */
+	TSharedPtr<FDppPendingReply, ESPMode::ThreadSafe> MakePendingReply(dpp::cluster* cluster, uint32 cluster_generation, dpp::snowflake interaction_id, const std::string& interaction_token) const;
+
+	/**
+	 * @brief Start tracking an interaction that's been queued for the GameThread. Called from the shard threads.
+	 * It can always be replied to, it just won't be deferred if the deferrer isn't running.
+	 */
+	void Track(const TSharedPtr<FDppPendingReply, ESPMode::ThreadSafe>& pending_reply);
+
+	/**
+	 * @brief Reply to a tracked interaction and record how long the reply took. Called from the GameThread.
+	 */
+	void Reply(dpp::cluster& current_cluster, FDppPendingReply& pending_reply, dpp::message&& msg);
+
+	struct FStats
+	{
+		uint64 replies = 0;
+		uint64 deferred = 0;
+		double last_latency = 0.0;
+		double average_latency = 0.0;
+		double max_latency = 0.0;
+	};
+
+	FStats GetStats() const;
+
+	virtual uint32 Run() override;
+	virtual void Stop() override;
+
+private:
+
+	struct FDeadline
+	{
+		double seconds;
+		TSharedPtr<FDppPendingReply, ESPMode::ThreadSafe> pending_reply;
+
+		bool operator<(const FDeadline& other) const
+		{
+			return seconds < other.seconds;
+		}
+	};
+
+	mutable FCriticalSection lock;
+
+	/**
+	 * @brief Heap of interactions still waiting, earliest deadline first.
+	 */
+	TArray<FDeadline> deadlines;
+
+	bool running = false;
+
+	/**
+	 * @brief The only generation that gets tracked, see Start.
+	 */
+	uint32 tracked_generation = 0;
+
+	FEvent* wake_event = nullptr;
+	FRunnableThread* thread = nullptr;
+
+	std::atomic<bool> stopping{false};
+	std::atomic<double> budget{-1.0};
+	std::atomic<bool> defer_ephemeral{false};
+
+	std::atomic<uint64> deferred{0};
+
+	/**
+	 * @brief Only touched by the GameThread, through Reply and GetStats.
+	 */
+	uint64 replies = 0;
+	double total_latency = 0.0;
+	double last_latency = 0.0;
+	double max_latency = 0.0;
+};
@@ -0,0 +1,264 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DppRestCoalescer.h"
+
+namespace
+{
+	// Discord only bulk deletes 2 to 100 messages, and none older than two weeks.
+	constexpr size_t bulk_delete_min = 2;
+	constexpr size_t bulk_delete_max = 100;
+	constexpr uint64 bulk_delete_max_age_ms = (14ull * 24 * 60 * 60 - 60) * 1000;
+	constexpr uint64 discord_epoch_ms = 1420070400000ull;
+
+	bool CanBulkDelete(const dpp::snowflake message_id)
+	{
+		const uint64 created_ms = (static_cast<uint64>(message_id) >> 22) + discord_epoch_ms;
+		const uint64 now_ms = static_cast<uint64>(FDateTime::UtcNow().ToUnixTimestamp()) * 1000;
+		return now_ms < created_ms + bulk_delete_max_age_ms;
+	}
+
+	void CallAll(const std::vector<dpp::command_completion_event_t>& callbacks, const dpp::confirmation_callback_t& result)
+	{
+		for(const dpp::command_completion_event_t& callback : callbacks)
+		{
+			if(callback)
+				callback(result);
+		}
+	}
+
+	dpp::confirmation_callback_t NotSentResult()
+	{
+		dpp::http_request_completion_t http;
+		http.error = dpp::h_canceled;
+		http.body = R"({"code":0,"message":"The bot was stopped before the request was sent."})";
+		return dpp::confirmation_callback_t(http);
+	}
+}
+
+void FDppRestCoalescer::SetCluster(dpp::cluster* new_cluster)
+{
+	std::vector<dpp::command_completion_event_t> not_sent;
+
+	{
+		FScopeLock scope_lock(&lock);
+
+		if(!new_cluster)
+			not_sent = TakePending();
+
+		cluster = new_cluster;
+	}
+
+	CallAll(not_sent, NotSentResult());
+}
+
+void FDppRestCoalescer::SetBatchWindow(const double seconds)
+{
+	FScopeLock scope_lock(&lock);
+	batch_window = FMath::Max(seconds, 0.0);
+}
+
+void FDppRestCoalescer::user_get(const dpp::snowflake user_id, dpp::command_completion_event_t callback)
+{
+	SendShared("user_get/" + user_id.str(), MoveTemp(callback), [user_id](dpp::cluster& bot, dpp::command_completion_event_t on_complete)
+	{
+		bot.user_get(user_id, MoveTemp(on_complete));
+	});
+}
+
+void FDppRestCoalescer::guild_get_member(const dpp::snowflake guild_id, const dpp::snowflake user_id, dpp::command_completion_event_t callback)
+{
+	SendShared("guild_get_member/" + guild_id.str() + "/" + user_id.str(), MoveTemp(callback), [guild_id, user_id](dpp::cluster& bot, dpp::command_completion_event_t on_complete)
+	{
+		bot.guild_get_member(guild_id, user_id, MoveTemp(on_complete));
+	});
+}
+
+void FDppRestCoalescer::guild_member_add_role(const dpp::snowflake guild_id, const dpp::snowflake user_id, const dpp::snowflake role_id, dpp::command_completion_event_t callback)
+{
+	SendShared("guild_member_add_role/" + guild_id.str() + "/" + user_id.str() + "/" + role_id.str(), MoveTemp(callback),
+		[guild_id, user_id, role_id](dpp::cluster& bot, dpp::command_completion_event_t on_complete)
+		{
+			bot.guild_member_add_role(guild_id, user_id, role_id, MoveTemp(on_complete));
+		});
+}
+
+void FDppRestCoalescer::message_delete(const dpp::snowflake message_id, const dpp::snowflake channel_id, dpp::command_completion_event_t callback)
+{
+	{
+		FScopeLock scope_lock(&lock);
+
+		if(cluster)
+		{
+			FPendingDeletes& deletes = pending_deletes[channel_id];
+
+			if(deletes.messages.empty())
+				deletes.first_queued_seconds = FPlatformTime::Seconds();
+
+			deletes.messages[message_id].push_back(MoveTemp(callback));
+
+			// A full bulk delete has nothing left to wait for.
+			if(deletes.messages.size() >= bulk_delete_max)
+				SendDeletes(channel_id);
+
+			return;
+		}
+	}
+
+	if(callback)
+		callback(NotSentResult());
+}
+
+void FDppRestCoalescer::Flush()
+{
+	FScopeLock scope_lock(&lock);
+
+	if(!cluster)
+		return;
+
+	const double now = FPlatformTime::Seconds();
+	std::vector<dpp::snowflake> due_channels;
+
+	for(const auto& [channel_id, deletes] : pending_deletes)
+	{
+		if(now - deletes.first_queued_seconds >= batch_window)
+			due_channels.push_back(channel_id);
+	}
+
+	for(const dpp::snowflake channel_id : due_channels)
+		SendDeletes(channel_id);
+}
+
+bool FDppRestCoalescer::HasPendingDeletes() const
+{
+	FScopeLock scope_lock(&lock);
+	return !pending_deletes.empty();
+}
+
+FDppRestCoalescer::FStats FDppRestCoalescer::GetStats() const
+{
+	FScopeLock scope_lock(&lock);
+	return stats;
+}
+
+void FDppRestCoalescer::SendShared(std::string key, dpp::command_completion_event_t callback, TFunction<void(dpp::cluster&, dpp::command_completion_event_t)>&& send)
+{
+	{
+		FScopeLock scope_lock(&lock);
+
+		if(cluster)
+		{
+			const auto existing = in_flight.find(key);
+
+			if(existing != in_flight.end())
+			{
+				existing->second.callbacks.push_back(MoveTemp(callback));
+				++stats.coalesced;
+				return;
+			}
+
+			const uint64 ticket = ++next_ticket;
+
+			FInFlight& request = in_flight[key];
+			request.ticket = ticket;
+			request.callbacks.push_back(MoveTemp(callback));
+			++stats.sent;
+
+			// The result is the same for everyone who asked while it was in flight.
+			send(*cluster, [self = AsShared(), key, ticket](const dpp::confirmation_callback_t& result)
+			{
+				std::vector<dpp::command_completion_event_t> callbacks;
+
+				{
+					FScopeLock callback_lock(&self->lock);
+					const auto found = self->in_flight.find(key);
+
+					// Already failed by SetCluster(nullptr), and maybe sent again since through the new cluster.
+					if(found == self->in_flight.end() || found->second.ticket != ticket)
+						return;
+
+					callbacks = MoveTemp(found->second.callbacks);
+					self->in_flight.erase(found);
+				}
+
+				CallAll(callbacks, result);
+			});
+
+			return;
+		}
+	}
+
+	if(callback)
+		callback(NotSentResult());
+}
+
+void FDppRestCoalescer::SendDeletes(const dpp::snowflake channel_id)
+{
+	const auto found = pending_deletes.find(channel_id);
+
+	if(found == pending_deletes.end())
+		return;
+
+	FPendingDeletes deletes = MoveTemp(found->second);
+	pending_deletes.erase(found);
+
+	std::vector<dpp::snowflake> bulk_ids;
+	std::vector<dpp::command_completion_event_t> bulk_callbacks;
+
+	for(auto& [message_id, callbacks] : deletes.messages)
+	{
+		if(CanBulkDelete(message_id))
+		{
+			bulk_ids.push_back(message_id);
+			bulk_callbacks.insert(bulk_callbacks.end(), std::make_move_iterator(callbacks.begin()), std::make_move_iterator(callbacks.end()));
+			continue;
+		}
+
+		++stats.sent;
+		cluster->message_delete(message_id, channel_id, [callbacks = MoveTemp(callbacks)](const dpp::confirmation_callback_t& result)
+		{
+			CallAll(callbacks, result);
+		});
+	}
+
+	if(bulk_ids.size() >= bulk_delete_min)
+	{
+		++stats.sent;
+		stats.bulk_deleted += bulk_ids.size();
+
+		cluster->message_delete_bulk(bulk_ids, channel_id, [callbacks = MoveTemp(bulk_callbacks)](const dpp::confirmation_callback_t& result)
+		{
+			CallAll(callbacks, result);
+		});
+	}
+	else if(!bulk_ids.empty())
+	{
+		++stats.sent;
+
+		cluster->message_delete(bulk_ids.front(), channel_id, [callbacks = MoveTemp(bulk_callbacks)](const dpp::confirmation_callback_t& result)
+		{
+			CallAll(callbacks, result);
+		});
+	}
+}
+
+std::vector<dpp::command_completion_event_t> FDppRestCoalescer::TakePending()
+{
+	std::vector<dpp::command_completion_event_t> callbacks;
+
+	for(auto& [channel_id, deletes] : pending_deletes)
+	{
+		for(auto& [message_id, message_callbacks] : deletes.messages)
+			callbacks.insert(callbacks.end(), std::make_move_iterator(message_callbacks.begin()), std::make_move_iterator(message_callbacks.end()));
+	}
+
+	// D++ doesn't promise to call back requests that were still queued when the cluster went away.
+	// If it does, the request either won't be found anymore or will have a newer ticket, so nobody gets called twice or with a stale result.
+	for(auto& [key, request] : in_flight)
+		callbacks.insert(callbacks.end(), std::make_move_iterator(request.callbacks.begin()), std::make_move_iterator(request.callbacks.end()));
+
+	pending_deletes.clear();
+	in_flight.clear();
+
+	return callbacks;
+}
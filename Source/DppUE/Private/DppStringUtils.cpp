@@ -0,0 +1,217 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DppStringUtils.h"
+
+#include "Containers/LockFreeList.h"
+
+namespace
+{
+	void ConvertToUtf8(const FString& str, std::string& out)
+	{
+		const int32 source_length = str.Len();
+
+		if(source_length == 0)
+		{
+			out.clear();
+			return;
+		}
+
+		const int32 length = FPlatformString::ConvertedLength<UTF8CHAR>(*str, source_length);
+
+		// resize() keeps the capacity, so a reused buffer won't reallocate unless it has to grow.
+		out.resize(length);
+		FPlatformString::Convert(reinterpret_cast<UTF8CHAR*>(out.data()), length, *str, source_length);
+	}
+
+	void ConvertToFString(const std::string_view utf8, FString& out)
+	{
+		TArray<TCHAR>& chars = out.GetCharArray();
+
+		if(utf8.empty())
+		{
+			// Keeps the allocation, in case the buffer gets pooled.
+			chars.Reset();
+			return;
+		}
+
+		const UTF8CHAR* source = reinterpret_cast<const UTF8CHAR*>(utf8.data());
+		const int32 source_length = static_cast<int32>(utf8.size());
+		const int32 length = FPlatformString::ConvertedLength<TCHAR>(source, source_length);
+
+		chars.SetNumUninitialized(length + 1, false);
+		FPlatformString::Convert(chars.GetData(), length, source, source_length);
+		chars[length] = TEXT('\0');
+	}
+
+	/**
+	 * @brief Payloads that no string uses anymore, with their buffers still allocated.
+	 */
+	class FPayloadPool
+	{
+	public:
+
+		using FPayload = FDppUtf8String::FPayload;
+
+		FPayload* Acquire()
+		{
+			if(FPayload* payload = free_payloads.Pop())
+			{
+				--num_free;
+				return payload;
+			}
+
+			return new FPayload();
+		}
+
+		void Return(FPayload* payload)
+		{
+			// A one-off huge message shouldn't keep its buffers forever, and a burst shouldn't either.
+			if(num_free >= max_free || payload->utf8.capacity() > max_pooled_bytes)
+			{
+				delete payload;
+				return;
+			}
+
+			payload->utf8.clear();
+			payload->is_converted = false;
+
+			// The FString is bigger than the UTF-8 it came from, so it gets the same limit on its own.
+			if(payload->converted.GetAllocatedSize() > max_pooled_bytes)
+				payload->converted.Empty();
+			else
+				payload->converted.Reset();
+
+			++num_free;
+			free_payloads.Push(payload);
+		}
+
+	private:
+
+		static constexpr int32 max_free = 4096;
+		static constexpr size_t max_pooled_bytes = 4096;
+
+		TLockFreePointerListUnordered<FPayload, PLATFORM_CACHE_LINE_SIZE> free_payloads;
+		std::atomic<int32> num_free{0};
+	};
+
+	FPayloadPool& GetPayloadPool()
+	{
+		// Never destroyed, strings in static objects can still be released after everything else has shut down.
+		static FPayloadPool* pool = new FPayloadPool();
+		return *pool;
+	}
+}
+
+FString DppUE::Utf8ToFString(const std::string_view utf8)
+{
+	FString out;
+	ConvertToFString(utf8, out);
+	return out;
+}
+
+std::string DppUE::ToUtf8(const FString& str)
+{
+	std::string out;
+	ConvertToUtf8(str, out);
+	return out;
+}
+
+const std::string& DppUE::ToUtf8Scratch(const FString& str)
+{
+	thread_local std::string scratch;
+	ConvertToUtf8(str, scratch);
+	return scratch;
+}
+
+FDppUtf8String::FDppUtf8String(std::string&& utf8)
+{
+	payload = GetPayloadPool().Acquire();
+	payload->utf8 = MoveTemp(utf8);
+	payload->ref_count = 1;
+}
+
+FDppUtf8String::FDppUtf8String(const std::string& utf8)
+{
+	// Copied into the pooled buffer, which only allocates if the text is longer than anything it held before.
+	payload = GetPayloadPool().Acquire();
+	payload->utf8.assign(utf8);
+	payload->ref_count = 1;
+}
+
+FDppUtf8String::FDppUtf8String(const FDppUtf8String& other) : payload(other.payload)
+{
+	if(payload)
+		payload->ref_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+FDppUtf8String::FDppUtf8String(FDppUtf8String&& other) noexcept : payload(other.payload)
+{
+	other.payload = nullptr;
+}
+
+FDppUtf8String& FDppUtf8String::operator=(const FDppUtf8String& other)
+{
+	if(payload != other.payload)
+	{
+		if(other.payload)
+			other.payload->ref_count.fetch_add(1, std::memory_order_relaxed);
+
+		Release();
+		payload = other.payload;
+	}
+
+	return *this;
+}
+
+FDppUtf8String& FDppUtf8String::operator=(FDppUtf8String&& other) noexcept
+{
+	if(this != &other)
+	{
+		Release();
+		payload = other.payload;
+		other.payload = nullptr;
+	}
+
+	return *this;
+}
+
+FDppUtf8String::~FDppUtf8String()
+{
+	Release();
+}
+
+const std::string& FDppUtf8String::to_string() const
+{
+	static const std::string empty;
+	return payload ? payload->utf8 : empty;
+}
+
+const FString& FDppUtf8String::to_fstring() const
+{
+	static const FString empty;
+
+	if(!payload)
+		return empty;
+
+	if(!payload->is_converted)
+	{
+		ConvertToFString(payload->utf8, payload->converted);
+		payload->is_converted = true;
+	}
+
+	return payload->converted;
+}
+
+bool FDppUtf8String::is_empty() const
+{
+	return !payload || payload->utf8.empty();
+}
+
+void FDppUtf8String::Release()
+{
+	if(payload && payload->ref_count.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		GetPayloadPool().Return(payload);
+
+	payload = nullptr;
+}
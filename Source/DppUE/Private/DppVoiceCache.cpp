@@ -0,0 +1,72 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DppVoiceCache.h"
+
+FDppVoiceCache::FDppVoiceCache(const int64 budget_bytes) : sounds(budget_bytes)
+{
+}
+
+FDppVoiceClip FDppVoiceCache::Find(const FObjectKey& sound)
+{
+	FScopeLock scope_lock(&lock);
+
+	const FDppVoiceClip* packets = sounds.Find(sound);
+
+	if(!packets)
+	{
+		++misses;
+		return nullptr;
+	}
+
+	++hits;
+	return *packets;
+}
+
+void FDppVoiceCache::Add(const FObjectKey& sound, FDppVoicePackets&& packets)
+{
+	// The capture was reserved from an estimate, don't keep the slack around for as long as the sound is cached.
+	packets.data.Shrink();
+	packets.packet_ends.Shrink();
+
+	const int64 size = packets.GetAllocatedSize();
+
+	FScopeLock scope_lock(&lock);
+
+	if(!sounds.CanFit(size))
+		return;
+
+	sounds.Add(sound, MakeShared<const FDppVoicePackets, ESPMode::ThreadSafe>(MoveTemp(packets)), size);
+}
+
+bool FDppVoiceCache::CanFit(const int64 size) const
+{
+	FScopeLock scope_lock(&lock);
+	return sounds.CanFit(size);
+}
+
+void FDppVoiceCache::SetBudget(const int64 budget_bytes)
+{
+	FScopeLock scope_lock(&lock);
+	sounds.SetBudget(budget_bytes);
+}
+
+void FDppVoiceCache::Empty()
+{
+	FScopeLock scope_lock(&lock);
+	sounds.Empty();
+}
+
+FDppVoiceCache::FStats FDppVoiceCache::GetStats() const
+{
+	FScopeLock scope_lock(&lock);
+
+	FStats stats;
+	stats.bytes = sounds.GetBytes();
+	stats.budget = sounds.GetBudget();
+	stats.entries = sounds.Num();
+	stats.hits = hits;
+	stats.misses = misses;
+	stats.evictions = sounds.GetEvictions();
+	return stats;
+}
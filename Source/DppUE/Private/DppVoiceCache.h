@@ -0,0 +1,87 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/ObjectKey.h"
+#include "DppLruCache.h"
+
+/**
+ * @brief A whole sound, already encoded to the 20ms Opus packets that get sent to Discord.
+ */
+struct FDppVoicePackets
+{
+	/**
+	 * @brief Every packet, back to back.
+	 */
+	TArray<uint8> data;
+
+	/**
+	 * @brief Where each packet ends in data. A packet starts where the one before it ends.
+	 */
+	TArray<int32> packet_ends;
+
+	int64 GetAllocatedSize() const
+	{
+		return data.GetAllocatedSize() + packet_ends.GetAllocatedSize();
+	}
+};
+
+using FDppVoiceClip = TSharedPtr<const FDppVoicePackets, ESPMode::ThreadSafe>;
+
+/**
+ * @brief Keeps recently played sounds in the form they're sent to Discord, so playing them again skips decoding, resampling and encoding.
+ *
+ * Entries are evicted least recently used first once the cache goes over its memory budget.
+ * Safe to use from any thread, voice streams add to it from their own threads.
+ */
+class FDppVoiceCache
+{
+public:
+
+	explicit FDppVoiceCache(int64 budget_bytes);
+
+	/**
+	 * @brief Find a sound, marking it as recently used.
+	 * @return The packets, or nullptr if the sound isn't cached.
+	 */
+	FDppVoiceClip Find(const FObjectKey& sound);
+
+	/**
+	 * @brief Add a sound, evicting others if the cache goes over budget. Sounds bigger than the whole budget aren't cached.
+	 */
+	void Add(const FObjectKey& sound, FDppVoicePackets&& packets);
+
+	/**
+	 * @brief Would a sound of this size fit in the cache at all? Used to skip capturing sounds that would never be cached.
+	 */
+	bool CanFit(int64 bytes) const;
+
+	void SetBudget(int64 budget_bytes);
+
+	void Empty();
+
+	struct FStats
+	{
+		int64 bytes = 0;
+		int64 budget = 0;
+		int32 entries = 0;
+		uint64 hits = 0;
+		uint64 misses = 0;
+		uint64 evictions = 0;
+	};
+
+	FStats GetStats() const;
+
+private:
+
+	mutable FCriticalSection lock;
+
+	/**
+	 * @brief Streams still playing a sound keep their own reference, so evicting never pulls packets out from under them.
+	 */
+	TDppLruCache<FObjectKey, FDppVoiceClip> sounds;
+
+	uint64 hits = 0;
+	uint64 misses = 0;
+};
@@ -0,0 +1,420 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DppVoiceStream.h"
+
+#include "AudioDecompress.h"
+#include "AudioDevice.h"
+#include "HAL/RunnableThread.h"
+#include "Misc/ScopeExit.h"
+#include "Sound/SoundWave.h"
+
+#include <mutex>
+#include <shared_mutex>
+
+THIRD_PARTY_INCLUDES_START
+#include "opus.h"
+THIRD_PARTY_INCLUDES_END
+
+namespace
+{
+	// Discord only takes 48kHz, 16 bit, stereo.
+	constexpr int32 discord_sample_rate = 48000;
+
+	// One 20ms Opus frame, in interleaved stereo samples.
+	constexpr int32 opus_frame_samples = discord_sample_rate / 50 * 2;
+
+	// The largest packet Opus recommends allowing for, a 20ms frame is nowhere near this.
+	constexpr int32 opus_max_packet_bytes = 4000;
+
+	// Discord's default channel bitrate, anything above it gets thrown away by Discord anyway.
+	constexpr int32 opus_bitrate = 64000;
+}
+
+TSharedPtr<FDppVoiceStream> FDppVoiceStream::Create(dpp::discord_client* shard, const dpp::snowflake guild_id, USoundWave* sound_wave, const float lookahead_seconds, const TSharedPtr<FDppVoiceCache, ESPMode::ThreadSafe>& cache)
+{
+	check(IsInGameThread());
+
+	TSharedPtr<FDppVoiceStream> stream = MakeShareable(new FDppVoiceStream());
+	stream->shard = shard;
+	stream->guild_id = guild_id;
+	stream->lookahead_seconds = FMath::Max(lookahead_seconds, 0.0f);
+	stream->cache = cache;
+	stream->cache_key = FObjectKey(sound_wave);
+
+	if(cache)
+	{
+		stream->cached_packets = cache->Find(stream->cache_key);
+
+		// Already encoded, the stream only has to send it.
+		if(stream->cached_packets)
+			return stream;
+	}
+
+	if(!stream->InitSource(sound_wave))
+		return nullptr;
+
+	return stream;
+}
+
+TSharedPtr<FDppVoiceStream> FDppVoiceStream::CreatePrecache(USoundWave* sound_wave, const TSharedPtr<FDppVoiceCache, ESPMode::ThreadSafe>& cache)
+{
+	check(IsInGameThread());
+
+	TSharedPtr<FDppVoiceStream> stream = MakeShareable(new FDppVoiceStream());
+	stream->cache = cache;
+	stream->cache_key = FObjectKey(sound_wave);
+
+	if(cache->Find(stream->cache_key))
+		return nullptr;
+
+	if(!stream->InitSource(sound_wave))
+		return nullptr;
+
+	if(!stream->capturing)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("[DPP-UE]: The sound wave is too big for the voice cache, so it can't be precached."));
+		return nullptr;
+	}
+
+	return stream;
+}
+
+bool FDppVoiceStream::InitSource(USoundWave* sound_wave)
+{
+	FAudioDevice* audio_device = GEngine ? GEngine->GetMainAudioDeviceRaw() : nullptr;
+	FByteBulkData* bulk = audio_device ? sound_wave->GetCompressedData(sound_wave->GetRuntimeFormat(), sound_wave->GetPlatformCompressionOverridesForCurrentPlatform()) : nullptr;
+
+	// The compressed asset is preferred even when the wave has been decompressed already, it's a fraction of the size of the PCM.
+	if(!bulk || bulk->GetBulkDataSize() <= 0)
+	{
+		if(!sound_wave->RawPCMData || sound_wave->RawPCMDataSize <= 0)
+		{
+			UE_LOG(LogTemp, Error, TEXT("[DPP-UE]: Failed to get the compressed data from the sound wave."));
+			return false;
+		}
+
+		// Only waves with nothing but PCM end up here. The audio device can free RawPCMData at any time, so it has to be copied.
+		source_data.Append(sound_wave->RawPCMData, sound_wave->RawPCMDataSize);
+		source_bytes_left = sound_wave->RawPCMDataSize;
+		sample_rate = static_cast<int32>(sound_wave->GetSampleRateForCurrentPlatform());
+		num_channels = sound_wave->NumChannels;
+	}
+	else
+	{
+		// Only the compressed asset is kept around, it gets decoded a chunk at a time.
+		source_data.Append(static_cast<const uint8*>(bulk->LockReadOnly()), bulk->GetBulkDataSize());
+		bulk->Unlock();
+
+		decoder.Reset(audio_device->CreateCompressedAudioInfo(sound_wave));
+
+		FSoundQualityInfo quality_info;
+
+		if(!decoder || !decoder->ReadCompressedInfo(source_data.GetData(), source_data.Num(), &quality_info))
+		{
+			UE_LOG(LogTemp, Error, TEXT("[DPP-UE]: Failed to read the compressed audio info of the sound wave."));
+			return false;
+		}
+
+		source_bytes_left = quality_info.SampleDataSize;
+		sample_rate = quality_info.SampleRate;
+		num_channels = quality_info.NumChannels;
+	}
+
+	if(sample_rate <= 0 || num_channels <= 0)
+	{
+		UE_LOG(LogTemp, Error, TEXT("[DPP-UE]: The sound wave has an invalid sample rate or channel count."));
+		return false;
+	}
+
+	decode_buffer.SetNumUninitialized(MONO_PCM_BUFFER_SIZE * num_channels);
+
+	// A chunk resampled up to 48kHz stereo plus a partial packet, so appending never reallocates.
+	const int32 chunk_frames = MONO_PCM_BUFFER_SAMPLES;
+	const int32 resampled_frames = FMath::CeilToInt(static_cast<double>(chunk_frames) * discord_sample_rate / sample_rate) + 1;
+	pending_output.Reserve(resampled_frames * 2 + opus_frame_samples);
+
+	// Only capture what could actually be cached, there's no point holding a long clip in memory otherwise.
+	// The encoded size is estimated from the bitrate, Opus packets vary a little in size.
+	const int64 source_frames = source_bytes_left / (num_channels * sizeof(int16));
+	const int64 num_packets = FMath::DivideAndRoundUp<int64>(source_frames * discord_sample_rate / sample_rate * 2, opus_frame_samples);
+	const int64 packet_bytes = num_packets * (opus_bitrate / 8 / 50);
+
+	if(cache && cache->CanFit(packet_bytes + num_packets * sizeof(int32)))
+	{
+		capturing = true;
+		capture.data.Reserve(static_cast<int32>(packet_bytes));
+		capture.packet_ends.Reserve(static_cast<int32>(num_packets));
+	}
+
+	return true;
+}
+
+FDppVoiceStream::~FDppVoiceStream()
+{
+	if(thread)
+	{
+		Stop();
+		thread->Kill(true);
+		delete thread;
+		thread = nullptr;
+	}
+}
+
+void FDppVoiceStream::Start()
+{
+	thread = FRunnableThread::Create(this, TEXT("DppVoiceStream"), 0, TPri_AboveNormal);
+}
+
+void FDppVoiceStream::StopAndWait()
+{
+	Stop();
+
+	if(thread)
+		thread->WaitForCompletion();
+}
+
+void FDppVoiceStream::Stop()
+{
+	stopping = true;
+}
+
+uint32 FDppVoiceStream::Run()
+{
+	if(cached_packets)
+	{
+		int32 packet_start = 0;
+
+		for(const int32 packet_end : cached_packets->packet_ends)
+		{
+			if(stopping || !SendOpusPacket(cached_packets->data.GetData() + packet_start, packet_end - packet_start))
+				break;
+
+			packet_start = packet_end;
+		}
+
+		cached_packets.Reset();
+		finished = true;
+		return 0;
+	}
+
+	// Precaching needs an encoder too, it's the packets that get cached.
+	int error = OPUS_OK;
+	encoder = opus_encoder_create(discord_sample_rate, 2, OPUS_APPLICATION_AUDIO, &error);
+
+	if(error != OPUS_OK || !encoder)
+	{
+		UE_LOG(LogTemp, Error, TEXT("[DPP-UE]: Failed to create an Opus encoder. %s"), *FString(opus_strerror(error)));
+		encoder = nullptr;
+		finished = true;
+		return 0;
+	}
+
+	opus_encoder_ctl(encoder, OPUS_SET_BITRATE(opus_bitrate));
+
+	ON_SCOPE_EXIT
+	{
+		if(encoder)
+		{
+			opus_encoder_destroy(encoder);
+			encoder = nullptr;
+		}
+	};
+
+	bool keep_going = true;
+
+	while(keep_going && !stopping)
+	{
+		const int16* samples = nullptr;
+		const int32 num_frames = DecodeChunk(samples);
+
+		if(num_frames <= 0)
+			break;
+
+		Resample(samples, num_frames);
+		keep_going = SendPending(false);
+	}
+
+	if(keep_going && !stopping && SendPending(true) && capturing)
+	{
+		// Only whole sounds go in the cache, a stopped stream would cache a cut off sound.
+		cache->Add(cache_key, MoveTemp(capture));
+	}
+
+	// Nothing is needed past this point, don't hold onto the asset until the stream gets cleaned up.
+	decoder.Reset();
+	source_data.Empty();
+	pending_output.Empty();
+	capture = FDppVoicePackets();
+
+	finished = true;
+	return 0;
+}
+
+int32 FDppVoiceStream::DecodeChunk(const int16*& samples)
+{
+	if(source_bytes_left <= 0)
+		return 0;
+
+	const int32 frame_size = num_channels * sizeof(int16);
+	int32 bytes = decode_buffer.Num();
+
+	if(decoder.IsValid())
+	{
+		const bool done = decoder->ReadCompressedData(decode_buffer.GetData(), false, bytes);
+
+		// The decoder pads the last chunk with silence, so trim it to what's actually left.
+		bytes = static_cast<int32>(FMath::Min<int64>(bytes, source_bytes_left));
+		source_bytes_left = done ? 0 : source_bytes_left - bytes;
+		samples = reinterpret_cast<const int16*>(decode_buffer.GetData());
+	}
+	else
+	{
+		bytes = static_cast<int32>(FMath::Min<int64>(bytes, source_bytes_left));
+		samples = reinterpret_cast<const int16*>(source_data.GetData() + source_read_offset);
+		source_read_offset += bytes;
+		source_bytes_left -= bytes;
+	}
+
+	return bytes / frame_size;
+}
+
+void FDppVoiceStream::Resample(const int16* samples, const int32 num_frames)
+{
+	// Mono gets copied to both sides, anything past two channels is ignored.
+	const int32 right_offset = num_channels > 1 ? 1 : 0;
+
+	if(sample_rate == discord_sample_rate)
+	{
+		for(int32 frame = 0; frame < num_frames; ++frame)
+		{
+			const int16* frame_samples = samples + frame * num_channels;
+			pending_output.Add(frame_samples[0]);
+			pending_output.Add(frame_samples[right_offset]);
+		}
+
+		return;
+	}
+
+	// Linear interpolation. resample_position is relative to the start of this chunk, -1 being the last frame of the previous one.
+	const double step = static_cast<double>(sample_rate) / discord_sample_rate;
+
+	for(;;)
+	{
+		const int32 index = FMath::FloorToInt(resample_position);
+
+		if(index + 1 >= num_frames)
+			break;
+
+		const double alpha = resample_position - index;
+		const int16* next = samples + (index + 1) * num_channels;
+		const int16 left = index < 0 ? last_frame[0] : samples[index * num_channels];
+		const int16 right = index < 0 ? last_frame[1] : samples[index * num_channels + right_offset];
+
+		pending_output.Add(static_cast<int16>(FMath::RoundToInt(left + (next[0] - left) * alpha)));
+		pending_output.Add(static_cast<int16>(FMath::RoundToInt(right + (next[right_offset] - right) * alpha)));
+
+		resample_position += step;
+	}
+
+	resample_position -= num_frames;
+
+	const int16* last = samples + (num_frames - 1) * num_channels;
+	last_frame[0] = last[0];
+	last_frame[1] = last[right_offset];
+}
+
+bool FDppVoiceStream::SendPending(const bool end_of_stream)
+{
+	const int32 sent = SendPackets(pending_output.GetData(), pending_output.Num(), end_of_stream);
+
+	if(sent == INDEX_NONE)
+		return false;
+
+	pending_output.RemoveAt(0, sent, false);
+	return true;
+}
+
+int32 FDppVoiceStream::SendPackets(const int16* samples, const int32 num_samples, const bool end_of_stream)
+{
+	int32 sent = 0;
+	int16 padded_frame[opus_frame_samples];
+	uint8 packet[opus_max_packet_bytes];
+
+	while(num_samples - sent >= opus_frame_samples || (end_of_stream && num_samples > sent))
+	{
+		const int32 count = FMath::Min(opus_frame_samples, num_samples - sent);
+		const int16* frame = samples + sent;
+
+		// Opus only encodes whole frames, so a short last one is padded with silence.
+		if(count < opus_frame_samples)
+		{
+			FMemory::Memcpy(padded_frame, frame, count * sizeof(int16));
+			FMemory::Memzero(padded_frame + count, (opus_frame_samples - count) * sizeof(int16));
+			frame = padded_frame;
+		}
+
+		const opus_int32 packet_bytes = opus_encode(encoder, frame, opus_frame_samples / 2, packet, opus_max_packet_bytes);
+
+		if(packet_bytes < 0)
+		{
+			UE_LOG(LogTemp, Error, TEXT("[DPP-UE]: Failed to encode audio. %s"), *FString(opus_strerror(packet_bytes)));
+			return INDEX_NONE;
+		}
+
+		if(capturing)
+		{
+			capture.data.Append(packet, packet_bytes);
+			capture.packet_ends.Add(capture.data.Num());
+		}
+
+		// Precaching, there's nowhere to send to.
+		if(shard && !SendOpusPacket(packet, packet_bytes))
+			return INDEX_NONE;
+
+		sent += count;
+	}
+
+	return sent;
+}
+
+bool FDppVoiceStream::SendOpusPacket(const uint8* packet, const int32 packet_bytes)
+{
+	while(!stopping)
+	{
+		// D++ deletes the voice client while holding voice_mutex exclusively, whether the bot left or Discord disconnected it.
+		// Holding it shared makes sure the client can't go away mid-send, and it's let go between packets so leaving never waits long.
+		std::shared_lock voice_lock(shard->voice_mutex);
+
+		const auto found = shard->connecting_voice_channels.find(guild_id);
+		dpp::discord_voice_client* voice_client = found != shard->connecting_voice_channels.end() && found->second ? found->second->voiceclient : nullptr;
+
+		if(!voice_client || !voice_client->is_ready())
+		{
+			UE_LOG(LogTemp, Warning, TEXT("[DPP-UE]: The voice connection went away while streaming audio."));
+			return false;
+		}
+
+		if(voice_client->get_secs_remaining() > lookahead_seconds)
+		{
+			voice_lock.unlock();
+			FPlatformProcess::Sleep(0.005f);
+			continue;
+		}
+
+		try
+		{
+			// D++ copies the packet, it only has to stay valid for the call.
+			voice_client->send_audio_opus(const_cast<uint8*>(packet), packet_bytes);
+		}
+		catch(const dpp::voice_exception& e)
+		{
+			UE_LOG(LogTemp, Error, TEXT("[DPP-UE]: Failed to send audio. %s"), *FString(e.what()));
+			return false;
+		}
+
+		return true;
+	}
+
+	return false;
+}
@@ -0,0 +1,165 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include <atomic>
+
+#include "CoreMinimal.h"
+#include "HAL/Runnable.h"
+#include "UObject/ObjectKey.h"
+#include "DppVoiceCache.h"
+
+THIRD_PARTY_INCLUDES_START
+#include <dpp/dpp.h>
+THIRD_PARTY_INCLUDES_END
+
+class FRunnableThread;
+class ICompressedAudioInfo;
+class USoundWave;
+struct OpusEncoder;
+
+/**
+ * @brief Streams a USoundWave into a guild's voice connection from its own thread.
+ *
+ * The wave is decoded a small chunk at a time, resampled to the 48kHz 16 bit stereo that Discord wants,
+ * encoded to 20ms Opus frames on the stream's thread and sent with send_audio_opus. Only a small amount of
+ * audio is ever queued in the voice client ahead of playback, so memory stays flat no matter how long the clip is.
+ *
+ * The voice client is never held between packets. It's looked up under the shard's voice_mutex for every
+ * packet, the same lock D++ takes to delete it, so leaving the channel from either side can't free it mid-send.
+ *
+ * With a voice cache, the encoded packets are kept once the whole sound has played, and playing the same
+ * sound again just sends the cached packets, without decoding or encoding anything.
+ */
+class FDppVoiceStream : public FRunnable
+{
+public:
+
+	/**
+	 * @brief Gather everything needed from the sound wave. Must be called on the GameThread.
+	 * @return The stream, not yet started, or nullptr if the wave can't be streamed.
+	 */
+	static TSharedPtr<FDppVoiceStream> Create(dpp::discord_client* shard, dpp::snowflake guild_id, USoundWave* sound_wave, float lookahead_seconds, const TSharedPtr<FDppVoiceCache, ESPMode::ThreadSafe>& cache);
+
+	/**
+	 * @brief Create a stream that only decodes the sound into the cache, without sending it anywhere. Must be called on the GameThread.
+	 * @return The stream, not yet started, or nullptr if the sound is already cached or can't be decoded.
+	 */
+	static TSharedPtr<FDppVoiceStream> CreatePrecache(USoundWave* sound_wave, const TSharedPtr<FDppVoiceCache, ESPMode::ThreadSafe>& cache);
+
+	virtual ~FDppVoiceStream() override;
+
+	/**
+	 * @brief Start streaming on a new thread. Decoding starts straight away, so the first packet is sent within a frame.
+	 */
+	void Start();
+
+	/**
+	 * @brief Stop streaming and wait for the thread to exit. The thread checks for this between every packet, so this returns quickly.
+	 * @note Audio already handed to the voice client still plays.
+	 */
+	void StopAndWait();
+
+	bool IsFinished() const
+	{
+		return finished;
+	}
+
+	// FRunnable
+	virtual uint32 Run() override;
+	virtual void Stop() override;
+
+private:
+
+	FDppVoiceStream() = default;
+
+	/**
+	 * @brief Set up decoding of the sound wave, and capturing into the cache if it would fit.
+	 * @return False if the wave can't be decoded.
+	 */
+	bool InitSource(USoundWave* sound_wave);
+
+	/**
+	 * @brief Decode the next chunk of the wave.
+	 * @param samples Set to the decoded interleaved 16 bit samples. Valid until the next call.
+	 * @return The amount of frames decoded, zero once the wave is done.
+	 */
+	int32 DecodeChunk(const int16*& samples);
+
+	/**
+	 * @brief Resample interleaved 16 bit frames to 48kHz stereo and append them to pending_output.
+	 */
+	void Resample(const int16* samples, int32 num_frames);
+
+	/**
+	 * @brief Send every complete packet in pending_output, or everything left if this is the end of the stream.
+	 * @return False if the stream should stop (stopped, or the voice connection went away).
+	 */
+	bool SendPending(bool end_of_stream);
+
+	/**
+	 * @brief Encode 48kHz stereo samples into Opus frames, capture them and send them. A partial frame at the end is only sent if this is the end of the stream.
+	 * @return The amount of samples sent, or INDEX_NONE if the stream should stop.
+	 */
+	int32 SendPackets(const int16* samples, int32 num_samples, bool end_of_stream);
+
+	/**
+	 * @brief Wait until the voice client has less than lookahead_seconds of audio queued, then send an Opus packet.
+	 * @return False if the stream got stopped or the voice connection went away.
+	 */
+	bool SendOpusPacket(const uint8* packet, int32 packet_bytes);
+
+	/**
+	 * @brief The shard to send through. Null for streams that only fill the cache.
+	 */
+	dpp::discord_client* shard = nullptr;
+	dpp::snowflake guild_id;
+	float lookahead_seconds = 0.5f;
+
+	/**
+	 * @brief Either a decoder for the compressed asset, or already decompressed PCM.
+	 */
+	TUniquePtr<ICompressedAudioInfo> decoder;
+	TArray<uint8> source_data;
+	int64 source_bytes_left = 0;
+	int32 source_read_offset = 0;
+
+	int32 sample_rate = 0;
+	int32 num_channels = 0;
+
+	TArray<uint8> decode_buffer;
+
+	/**
+	 * @brief Resampler state, carried between chunks so there's no click at chunk boundaries.
+	 */
+	double resample_position = 0.0;
+	int16 last_frame[2] = {0, 0};
+
+	/**
+	 * @brief 48kHz stereo samples waiting to fill a packet.
+	 */
+	TArray<int16> pending_output;
+
+	/**
+	 * @brief Created on the stream's thread when it starts, so nothing is encoded on the GameThread. Cached sounds don't need one.
+	 */
+	OpusEncoder* encoder = nullptr;
+
+	TSharedPtr<FDppVoiceCache, ESPMode::ThreadSafe> cache;
+	FObjectKey cache_key;
+
+	/**
+	 * @brief Set when the sound was already cached, nothing needs decoding or encoding.
+	 */
+	FDppVoiceClip cached_packets;
+
+	/**
+	 * @brief Everything sent so far, added to the cache once the sound has been sent in full.
+	 */
+	FDppVoicePackets capture;
+	bool capturing = false;
+
+	FRunnableThread* thread = nullptr;
+	std::atomic<bool> stopping{false};
+	std::atomic<bool> finished{false};
+};
@@ -2,10 +2,17 @@
 
 #pragma once
 
+#include <condition_variable>
 #include <memory>
+#include <mutex>
+#include <thread>
 
 #include "CoreMinimal.h"
+#include "Tickable.h"
+#include "Misc/TVariant.h"
 #include "UObject/Object.h"
+#include "DppEventRing.h"
+#include "DppStringUtils.h"
 
 THIRD_PARTY_INCLUDES_START
 #include <dpp/dpp.h>
@@ -13,33 +20,136 @@ THIRD_PARTY_INCLUDES_END
 
 #include "ClusterObject.generated.h"
 
+class FDppAttachmentCache;
+class FDppPendingReply;
+class FDppReplyDeferrer;
+class FDppRestCoalescer;
+class FDppVoiceCache;
+class FDppVoiceStream;
+struct FPropertyTag;
+
 #pragma region Structs
 
 /**
  * @brief A discord snowflake.
+ * @note The id is stored as a number. Blueprints make and break it as a string through UDiscordSnowflakeLibrary.
+ * Assets, pin defaults and properties saved while it was a string (snowflake_id) still load, see the struct ops below.
  */
-USTRUCT(BlueprintType)
+USTRUCT(BlueprintType, meta=(HasNativeMake="DppUE.DiscordSnowflakeLibrary.MakeSnowflake", HasNativeBreak="DppUE.DiscordSnowflakeLibrary.BreakSnowflake"))
 struct FDiscordSnowflake
 {
 	GENERATED_BODY()
 
-	UPROPERTY(BlueprintReadWrite, Category="Discord|Snowflake")
-	FString snowflake_id;
+	FDiscordSnowflake() = default;
+
+	FDiscordSnowflake(const dpp::snowflake snowflake) : id(snowflake)
+	{
+	}
+
+	UPROPERTY()
+	uint64 id = 0;
+
+	/**
+	 * @brief Where the old string id lands when loading data saved before it became a number. Moved into id by PostSerialize.
+	 */
+	UPROPERTY()
+	FString snowflake_id_DEPRECATED;
+
+	/**
+	 * @brief Read pin defaults and pasted text in the old (snowflake_id="...") form, or a bare number.
+	 * Anything else, like the current (id=...) form, is left to the default import.
+	 */
+	bool ImportTextItem(const TCHAR*& Buffer, int32 PortFlags, UObject* Parent, FOutputDevice* ErrorText);
+
+	/**
+	 * @brief Load properties that used to be an FString or a uint64 before they became a snowflake.
+	 */
+	bool SerializeFromMismatchedTag(const FPropertyTag& Tag, FArchive& Ar);
+
+	void PostSerialize(const FArchive& Ar);
+
+	FORCEINLINE dpp::snowflake to_snowflake() const
+	{
+		return dpp::snowflake(id);
+	}
 
+	UE_DEPRECATED(5.0, "The id is no longer a string, use to_snowflake instead.")
 	FORCEINLINE dpp::snowflake string_id_to_snowflake() const
 	{
-		if(!snowflake_id.IsNumeric() || snowflake_id.Contains("-"))
+		return to_snowflake();
+	}
+
+	FString to_fstring() const
+	{
+		return id == 0 ? FString() : FString::Printf(TEXT("%llu"), id);
+	}
+
+	/**
+	 * @brief Parse a snowflake from a string. This is the only place a snowflake is ever parsed.
+	 * @return The snowflake, or an empty (zero) snowflake if the string isn't a valid non-negative number.
+	 */
+	static FDiscordSnowflake from_fstring(const FString& snowflake_id)
+	{
+		uint64 numerical_id = 0;
+
+		for(const TCHAR character : snowflake_id)
 		{
-			UE_LOG(LogTemp, Error, TEXT("Can't get snowflake from id. Make sure the id is a number and isn't negative."));
-			return dpp::snowflake(0);
+			const uint64 digit = character - TEXT('0');
+
+			if(digit > 9 || numerical_id > (MAX_uint64 - digit) / 10)
+			{
+				UE_LOG(LogTemp, Error, TEXT("Can't get snowflake from id. Make sure the id is a number and isn't negative."));
+				return FDiscordSnowflake();
+			}
+
+			numerical_id = numerical_id * 10 + digit;
 		}
 
-		const uint64 numerical_id = FCString::Strtoui64(*snowflake_id, nullptr, 10);
-		
-		return dpp::snowflake(numerical_id);
+		return FDiscordSnowflake(numerical_id);
+	}
+
+	bool is_empty() const
+	{
+		return id == 0;
+	}
+
+	bool operator==(const FDiscordSnowflake& other) const
+	{
+		return id == other.id;
+	}
+
+	bool operator!=(const FDiscordSnowflake& other) const
+	{
+		return id != other.id;
+	}
+
+	/**
+	 * @brief Snowflakes made around the same time only differ by a small increment in their low bits, which UE's plain 64 bit fold
+	 * leaves as they are. That bunches them into the same buckets, so every bit gets mixed in first (MurmurHash3's finaliser).
+	 */
+	friend uint32 GetTypeHash(const FDiscordSnowflake& snowflake)
+	{
+		uint64 hash = snowflake.id;
+		hash ^= hash >> 33;
+		hash *= 0xff51afd7ed558ccdull;
+		hash ^= hash >> 33;
+		hash *= 0xc4ceb9fe1a85ec53ull;
+		hash ^= hash >> 33;
+		return static_cast<uint32>(hash);
 	}
 };
 
+template<>
+struct TStructOpsTypeTraits<FDiscordSnowflake> : public TStructOpsTypeTraitsBase2<FDiscordSnowflake>
+{
+	enum
+	{
+		WithImportTextItem = true,
+		WithSerializeFromMismatchedTag = true,
+		WithPostSerialize = true,
+	};
+};
+
 /**
  * @brief A message component (buttons).
  */
@@ -59,12 +169,12 @@ struct FMessageComponent
 
 	std::string label_to_string() const
 	{
-		return std::string(TCHAR_TO_UTF8(*component_label));
+		return DppUE::ToUtf8(component_label);
 	}
 
 	std::string id_to_string() const
 	{
-		return std::string(TCHAR_TO_UTF8(*component_id));
+		return DppUE::ToUtf8(component_id);
 	}
 };
 
@@ -123,40 +233,54 @@ struct FSlashcommand_Data
 
 	std::string name_to_string() const
 	{
-		return std::string(TCHAR_TO_UTF8(*command_name));
+		return DppUE::ToUtf8(command_name);
 	}
 
 	std::string description_to_string() const
 	{
-		return std::string(TCHAR_TO_UTF8(*command_description));
+		return DppUE::ToUtf8(command_description);
 	}
 };
 
 /**
- * @brief The information from a message event.
+ * @brief The information from a slashcommand event.
+ * @note Strings are kept as the UTF-8 that Discord sent, and only converted when Blueprints break the struct.
  */
-USTRUCT(BlueprintType)
+USTRUCT(BlueprintType, meta=(HasNativeBreak="DppUE.DiscordEventLibrary.BreakSlashcommandEvent", HasNativeMake="DppUE.DiscordEventLibrary.MakeSlashcommandEvent"))
 struct FSlashcommand_Event
 {
 	GENERATED_BODY()
 
-	UPROPERTY(BlueprintReadWrite, Category="Discord|Events|Command")
-	FString command_name;
+	FDppUtf8String command_name;
 
-	UPROPERTY(BlueprintReadWrite, Category="Discord|Events|Command")
-	FString issuing_user;
+	FDppUtf8String issuing_user;
 
 	UPROPERTY(BlueprintReadWrite, Category="Discord|Events|Command")
 	FDiscordSnowflake issuing_user_id;
 
-	std::string name_to_string() const
+	/**
+	 * @brief The interaction this command came from. Used to reply without holding onto the whole dpp::slashcommand_t.
+	 */
+	dpp::snowflake interaction_id;
+
+	/**
+	 * @brief The continuation token for replying to the interaction.
+	 */
+	std::string interaction_token;
+
+	/**
+	 * @brief The reply the bot owes this interaction. Replies go through it, so they become edits if the interaction had to be deferred.
+	 */
+	TSharedPtr<FDppPendingReply, ESPMode::ThreadSafe> pending_reply;
+
+	const std::string& name_to_string() const
 	{
-		return std::string(TCHAR_TO_UTF8(*command_name));
+		return command_name.to_string();
 	}
 
-	std::string issuing_user_to_string() const
+	const std::string& issuing_user_to_string() const
 	{
-		return std::string(TCHAR_TO_UTF8(*issuing_user));
+		return issuing_user.to_string();
 	}
 };
 
@@ -177,31 +301,38 @@ struct FSlashcommand_Reply
 
 /**
  * @brief The information from a button click event.
+ * @note Strings are kept as the UTF-8 that Discord sent, and only converted when Blueprints break the struct.
  */
-USTRUCT(BlueprintType)
+USTRUCT(BlueprintType, meta=(HasNativeBreak="DppUE.DiscordEventLibrary.BreakButtonClickEvent", HasNativeMake="DppUE.DiscordEventLibrary.MakeButtonClickEvent"))
 struct FButtonClick_Event
 {
 	GENERATED_BODY()
 
-	UPROPERTY(BlueprintReadWrite, Category="Discord|Events|Button")
-	FString custom_id;
+	FDppUtf8String custom_id;
 
-	UPROPERTY(BlueprintReadWrite, Category="Discord|Events|Button")
-	FString issuing_user;
+	FDppUtf8String issuing_user;
 
 	UPROPERTY(BlueprintReadWrite, Category="Discord|Events|Button")
 	FDiscordSnowflake issuing_user_id;
 
-	dpp::button_click_t raw_event;
+	/**
+	 * @brief The interaction this click came from. Used to reply without holding onto the whole dpp::button_click_t.
+	 */
+	dpp::snowflake interaction_id;
 
-	std::string custom_id_to_string() const
+	/**
+	 * @brief The continuation token for replying to the interaction.
+	 */
+	std::string interaction_token;
+
+	const std::string& custom_id_to_string() const
 	{
-		return std::string(TCHAR_TO_UTF8(*custom_id));
+		return custom_id.to_string();
 	}
 
-	std::string issuing_user_to_string() const
+	const std::string& issuing_user_to_string() const
 	{
-		return std::string(TCHAR_TO_UTF8(*issuing_user));
+		return issuing_user.to_string();
 	}
 };
 
@@ -227,25 +358,44 @@ struct FButtonClick_Reply
 };
 
 /**
- * @brief The information from a slashcommand event.
+ * @brief The information from a message event.
+ * @note Strings are kept as the UTF-8 that Discord sent, and only converted when Blueprints break the struct.
  */
-USTRUCT(BlueprintType)
+USTRUCT(BlueprintType, meta=(HasNativeBreak="DppUE.DiscordEventLibrary.BreakMessageEvent", HasNativeMake="DppUE.DiscordEventLibrary.MakeMessageEvent"))
 struct FMessage_event
 {
 	GENERATED_BODY()
 
+	/**
+	 * @brief The message that was sent. Its content is left empty so it's only converted if something reads it.
+	 * Blueprints get it filled in by Break and GetMessageContent, C++ reads it through content_to_fstring.
+	 */
 	UPROPERTY(BlueprintReadWrite, Category="Discord|Events|Message")
 	FDiscordMessage message;
 
-	UPROPERTY(BlueprintReadWrite, Category="Discord|Events|Message")
-	FString message_creator;
+	FDppUtf8String content;
+
+	FDppUtf8String message_creator;
 
 	UPROPERTY(BlueprintReadWrite, Category="Discord|Events|Message")
 	FDiscordSnowflake message_creator_id;
 
-	std::string message_creator_to_string() const
+	const std::string& content_to_string() const
 	{
-		return std::string(TCHAR_TO_UTF8(*message_creator));
+		return content.to_string();
+	}
+
+	/**
+	 * @brief The content as an FString. Converted on the first call, then cached. GameThread only.
+	 */
+	const FString& content_to_fstring() const
+	{
+		return content.to_fstring();
+	}
+
+	const std::string& message_creator_to_string() const
+	{
+		return message_creator.to_string();
 	}
 };
 
@@ -270,6 +420,53 @@ enum class EActivityType : uint8
 	AT_COMPETING	UMETA(DisplayName="Competing in..."),
 };
 
+UENUM(BlueprintType)
+enum class ECachePolicyType : uint8
+{
+	CP_Aggressive	UMETA(DisplayName="Aggressive", ToolTip="Cache everything as soon as it's seen. Fastest, but uses the most memory."),
+	CP_Lazy			UMETA(DisplayName="Lazy", ToolTip="Only cache things when there's activity involving them, e.g. a message to the bot."),
+	CP_None			UMETA(DisplayName="None", ToolTip="Don't cache anything, details are filled in when they're seen."),
+};
+
+/**
+ * @brief What the bot keeps in D++'s caches. Lazy or None keep memory down on big bots, at the cost of more CPU time.
+ * @note D++ always caches guilds and channels as it needs them itself, so their policy only decides how eagerly they're filled.
+ */
+USTRUCT(BlueprintType)
+struct FCachePolicy
+{
+	GENERATED_BODY()
+
+	/**
+	 * @brief Users and guild members. This is where most of the memory goes on big bots.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Discord|Cache")
+	ECachePolicyType user_policy = ECachePolicyType::CP_Aggressive;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Discord|Cache")
+	ECachePolicyType emoji_policy = ECachePolicyType::CP_Aggressive;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Discord|Cache")
+	ECachePolicyType role_policy = ECachePolicyType::CP_Aggressive;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Discord|Cache")
+	ECachePolicyType channel_policy = ECachePolicyType::CP_Aggressive;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Discord|Cache")
+	ECachePolicyType guild_policy = ECachePolicyType::CP_Aggressive;
+
+	dpp::cache_policy_t to_cache_policy() const
+	{
+		return {
+			static_cast<dpp::cache_policy_setting_t>(user_policy),
+			static_cast<dpp::cache_policy_setting_t>(emoji_policy),
+			static_cast<dpp::cache_policy_setting_t>(role_policy),
+			static_cast<dpp::cache_policy_setting_t>(channel_policy),
+			static_cast<dpp::cache_policy_setting_t>(guild_policy),
+		};
+	}
+};
+
 /**
  * @brief The information from a slashcommand event.
  */
@@ -299,24 +496,253 @@ struct FStatus
 
 	std::string status_to_string() const
 	{
-		return std::string(TCHAR_TO_UTF8(*status));
+		return DppUE::ToUtf8(status);
 	}
 };
 
+/**
+ * @brief Counters for the queue that carries events from the shard threads to the GameThread.
+ */
+USTRUCT(BlueprintType)
+struct FEventQueueStats
+{
+	GENERATED_BODY()
+
+	/**
+	 * @brief How many events the queue can hold before it starts dropping them.
+	 */
+	UPROPERTY(BlueprintReadOnly, Category="Discord|Cluster")
+	int64 capacity = 0;
+
+	/**
+	 * @brief How many events are currently waiting for the GameThread.
+	 */
+	UPROPERTY(BlueprintReadOnly, Category="Discord|Cluster")
+	int64 pending = 0;
+
+	/**
+	 * @brief How many events have been pushed by the shard threads in total.
+	 */
+	UPROPERTY(BlueprintReadOnly, Category="Discord|Cluster")
+	int64 pushed = 0;
+
+	/**
+	 * @brief How many events have been dispatched on the GameThread in total.
+	 */
+	UPROPERTY(BlueprintReadOnly, Category="Discord|Cluster")
+	int64 dispatched = 0;
+
+	/**
+	 * @brief How many events were dropped because the queue was full.
+	 */
+	UPROPERTY(BlueprintReadOnly, Category="Discord|Cluster")
+	int64 dropped = 0;
+
+	/**
+	 * @brief The most events that have been waiting at once.
+	 */
+	UPROPERTY(BlueprintReadOnly, Category="Discord|Cluster")
+	int64 high_watermark = 0;
+};
+
+/**
+ * @brief Counters for the cache of sounds ready to be sent to voice channels.
+ */
+USTRUCT(BlueprintType)
+struct FVoiceCacheStats
+{
+	GENERATED_BODY()
+
+	/**
+	 * @brief How much memory the cached sounds use.
+	 */
+	UPROPERTY(BlueprintReadOnly, Category="Discord|Audio")
+	int64 bytes = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category="Discord|Audio")
+	int64 budget_bytes = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category="Discord|Audio")
+	int32 sounds = 0;
+
+	/**
+	 * @brief How many plays were sent straight from the cache.
+	 */
+	UPROPERTY(BlueprintReadOnly, Category="Discord|Audio")
+	int64 hits = 0;
+
+	/**
+	 * @brief How many plays had to decode the sound.
+	 */
+	UPROPERTY(BlueprintReadOnly, Category="Discord|Audio")
+	int64 misses = 0;
+
+	/**
+	 * @brief How many sounds were dropped to stay under budget.
+	 */
+	UPROPERTY(BlueprintReadOnly, Category="Discord|Audio")
+	int64 evictions = 0;
+};
+
+/**
+ * @brief How quickly slash commands are replied to, measured from Discord's event arriving to the reply going out.
+ */
+USTRUCT(BlueprintType)
+struct FInteractionReplyStats
+{
+	GENERATED_BODY()
+
+	UPROPERTY(BlueprintReadOnly, Category="Discord|Commands")
+	int64 replies = 0;
+
+	/**
+	 * @brief How many replies took longer than the budget, and were sent as an edit of a "thinking" response.
+	 */
+	UPROPERTY(BlueprintReadOnly, Category="Discord|Commands")
+	int64 deferred = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category="Discord|Commands")
+	float last_latency_ms = 0.0f;
+
+	UPROPERTY(BlueprintReadOnly, Category="Discord|Commands")
+	float average_latency_ms = 0.0f;
+
+	UPROPERTY(BlueprintReadOnly, Category="Discord|Commands")
+	float max_latency_ms = 0.0f;
+};
+
+/**
+ * @brief How much memory one of D++'s caches is using.
+ */
+USTRUCT(BlueprintType)
+struct FCacheMemoryUsage
+{
+	GENERATED_BODY()
+
+	UPROPERTY(BlueprintReadOnly, Category="Discord|Cache")
+	int64 count = 0;
+
+	/**
+	 * @brief An estimate of the objects, the strings and vectors they own, and the cache holding them.
+	 */
+	UPROPERTY(BlueprintReadOnly, Category="Discord|Cache")
+	int64 bytes = 0;
+};
+
+/**
+ * @brief How much memory a single guild is using, including its members, channels and roles.
+ */
+USTRUCT(BlueprintType)
+struct FGuildMemoryUsage
+{
+	GENERATED_BODY()
+
+	UPROPERTY(BlueprintReadOnly, Category="Discord|Cache")
+	FDiscordSnowflake guild_id;
+
+	UPROPERTY(BlueprintReadOnly, Category="Discord|Cache")
+	int64 members = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category="Discord|Cache")
+	int64 bytes = 0;
+};
+
+/**
+ * @brief How much memory D++'s caches are using. These are shared by every bot in the process.
+ */
+USTRUCT(BlueprintType)
+struct FCacheMemoryStats
+{
+	GENERATED_BODY()
+
+	UPROPERTY(BlueprintReadOnly, Category="Discord|Cache")
+	FCacheMemoryUsage users;
+
+	/**
+	 * @brief Guilds, including their member maps when measured deep.
+	 */
+	UPROPERTY(BlueprintReadOnly, Category="Discord|Cache")
+	FCacheMemoryUsage guilds;
+
+	UPROPERTY(BlueprintReadOnly, Category="Discord|Cache")
+	FCacheMemoryUsage channels;
+
+	UPROPERTY(BlueprintReadOnly, Category="Discord|Cache")
+	FCacheMemoryUsage roles;
+
+	UPROPERTY(BlueprintReadOnly, Category="Discord|Cache")
+	FCacheMemoryUsage emojis;
+
+	UPROPERTY(BlueprintReadOnly, Category="Discord|Cache")
+	int64 total_bytes = 0;
+
+	/**
+	 * @brief Every cached guild, biggest first. Channels and roles are counted in their guild as well as in their own cache.
+	 * @note Only filled when measured deep.
+	 */
+	UPROPERTY(BlueprintReadOnly, Category="Discord|Cache")
+	TArray<FGuildMemoryUsage> guild_breakdown;
+};
+
 #pragma endregion
 
+/**
+ * @brief A shard finished connecting. The shard is only handed to the GameThread through the queue, never written from the shard thread.
+ */
+struct FClusterReady_QueuedEvent
+{
+	dpp::discord_client* shard = nullptr;
+};
+
+/**
+ * @brief The bot got disconnected from a guild's voice channel, by leaving or by Discord (kicked, channel deleted, region moved).
+ */
+struct FVoiceDisconnect_QueuedEvent
+{
+	dpp::snowflake guild_id;
+};
+
+/**
+ * @brief An event waiting in the queue for the GameThread. Everything in here is already translated, so draining it is cheap.
+ * @note Messages have a queue of their own, see FClusterMessageEntry.
+ */
+using FClusterQueuedEvent = TVariant<FSlashcommand_Event, FButtonClick_Event, FClusterReady_QueuedEvent, FVoiceDisconnect_QueuedEvent>;
+
+/**
+ * @brief A queued event, tagged with the cluster it came from. Events from a cluster that has since been stopped are dropped, not dispatched.
+ */
+struct FClusterQueueEntry
+{
+	uint32 cluster_generation = 0;
+
+	FClusterQueuedEvent event;
+};
+
+/**
+ * @brief A queued message, tagged the same way as FClusterQueueEntry.
+ */
+struct FClusterMessageEntry
+{
+	uint32 cluster_generation = 0;
+
+	FMessage_event event;
+};
+
 DECLARE_DYNAMIC_MULTICAST_DELEGATE(FClusterReady);
 //DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnSlashcommand, const FSlashcommand_Event&, event);
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnMessageCreate, const FMessage_event&, event);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnMessagesCreated, const TArray<FMessage_event>&, events);
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnButtonClick, const FButtonClick_Event&, event);
 DECLARE_DYNAMIC_DELEGATE_OneParam(FOnMessageSent, bool, success);
+DECLARE_DYNAMIC_DELEGATE_OneParam(FOnMessageDeleted, bool, success);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnCacheMemoryStats, const FCacheMemoryStats&, stats);
 
 /**
  * @brief The cluster object that your bot runs off. This manages all the back-end work with DPP and handles a lot of features for you.
  * @note Blueprints does not have all the information that C++ does. If you are wanting to create complicated logic then seek to use C++.
  */
 UCLASS(Blueprintable, BlueprintType)
-class DPPUE_API UClusterObject : public UObject
+class DPPUE_API UClusterObject : public UObject, public FTickableGameObject
 {
 	GENERATED_BODY()
 
@@ -325,17 +751,42 @@ public:
 	UClusterObject();
 
 	virtual void BeginDestroy() override;
+	virtual bool IsReadyForFinishDestroy() override;
+	virtual void FinishDestroy() override;
+
+	// FTickableGameObject
+	virtual void Tick(float DeltaTime) override;
+	virtual ETickableTickType GetTickableTickType() const override;
+	virtual bool IsTickable() const override;
+	virtual bool IsTickableInEditor() const override;
+	virtual TStatId GetStatId() const override;
 
 #pragma region Functions
 
 	UFUNCTION(BlueprintCallable, Category = "Discord|Cluster")
 	void CreateBot(const FString& token, const bool enableMessageIntent, const bool enableGuildIntent, const bool enableGuildPresenceIntent);
 
+	/**
+	 * @brief Start the bot created by CreateBot. Can be called again after StopBot to restart it.
+	 * @note Never waits for a previous bot to finish shutting down, it keeps shutting down in the background while the new one starts.
+	 */
 	UFUNCTION(BlueprintCallable, Category="Discord|Cluster")
 	void StartBot();
 
-	//UFUNCTION(BlueprintCallable, Category="Discord|Cluster")
-	//void StopBot();
+	/**
+	 * @brief Stop the bot. This never blocks, the shards are shut down in the background.
+	 */
+	UFUNCTION(BlueprintCallable, Category="Discord|Cluster")
+	void StopBot();
+
+	/**
+	 * @brief Stop the bot and start a new cluster straight away. Neither step blocks, the old cluster shuts down in the background.
+	 */
+	UFUNCTION(BlueprintCallable, Category="Discord|Cluster")
+	void RestartBot();
+
+	UFUNCTION(BlueprintPure, Category="Discord|Cluster")
+	bool IsBotRunning() const;
 
 	UFUNCTION(BlueprintCallable, Category="Discord|Commands")
 	void CreateCommand(FSlashcommand_Data command);
@@ -346,6 +797,12 @@ public:
 	UFUNCTION(BlueprintNativeEvent, Category="Discord|Events")
 	FSlashcommand_Reply OnSlashcommand(FSlashcommand_Event event);
 
+	/**
+	 * @brief Get how long slash commands took to reply, and how many had to be deferred.
+	 */
+	UFUNCTION(BlueprintPure, Category="Discord|Commands")
+	FInteractionReplyStats GetInteractionReplyStats() const;
+
 	//UFUNCTION(BlueprintNativeEvent, Category="Discord|Events")
 	//FButtonClick_Reply OnButtonClick(FButtonClick_Event event);
 
@@ -358,17 +815,212 @@ public:
 	UFUNCTION(BlueprintCallable, Category="Discord|Audio")
 	void LeaveVoiceChannel(FDiscordSnowflake GuildID);
 
+	/**
+	 * @brief Stream a sound wave into the voice channel the bot is in for this guild. Anything already playing from this object is replaced.
+	 * @return True if streaming started. The sound is decoded and sent in the background.
+	 */
 	UFUNCTION(BlueprintCallable, Category="Discord|Audio")
 	bool PlayAudioInGuild(FDiscordSnowflake GuildID, USoundWave* SoundWave);
 
+	/**
+	 * @brief Stop streaming audio into a guild. Audio that has already been sent still plays out.
+	 */
+	UFUNCTION(BlueprintCallable, Category="Discord|Audio")
+	void StopAudioInGuild(FDiscordSnowflake GuildID);
+
+	/**
+	 * @brief Decode and encode a sound into the voice cache in the background, so its first play doesn't have to.
+	 */
+	UFUNCTION(BlueprintCallable, Category="Discord|Audio")
+	void PrecacheSound(USoundWave* SoundWave);
+
+	UFUNCTION(BlueprintCallable, Category="Discord|Audio")
+	void ClearVoiceCache();
+
+	UFUNCTION(BlueprintPure, Category="Discord|Audio")
+	FVoiceCacheStats GetVoiceCacheStats() const;
+
 	UFUNCTION(BlueprintCallable, Category="Discord|Cluster")
 	void SetBotStatus(FStatus status);
 	
+	/**
+	 * @brief Send a message to its channel.
+	 * Messages to the same channel are sent in the order this is called, even if an earlier one is still loading its attachment.
+	 */
 	UFUNCTION(BlueprintCallable, Category="Discord|Messages")
 	void SendMessageToChannel(FDiscordMessage message, FOnMessageSent messageCallback);
+
+	/**
+	 * @brief Delete a message. Deletes in the same channel within delete_batch_window_seconds are sent as one bulk delete.
+	 */
+	UFUNCTION(BlueprintCallable, Category="Discord|Messages")
+	void DeleteMessage(FDiscordSnowflake ChannelID, FDiscordSnowflake MessageID, FOnMessageDeleted deleteCallback);
+
+	/**
+	 * @brief Get the REST coalescer for this bot. Use it from C++ in place of the matching dpp::cluster calls, so repeated
+	 * lookups share one request and message deletes get batched.
+	 */
+	TSharedPtr<FDppRestCoalescer, ESPMode::ThreadSafe> GetRestCoalescer() const;
+
+	/**
+	 * @brief Get the counters of the queue carrying interactions from the shard threads to the GameThread.
+	 * Use this to tune max_events_per_frame and event_queue_capacity.
+	 */
+	UFUNCTION(BlueprintPure, Category="Discord|Cluster")
+	FEventQueueStats GetEventQueueStats() const;
+
+	/**
+	 * @brief Get the counters of the queue carrying messages from the shard threads to the GameThread.
+	 * Use this to tune max_messages_per_frame and message_queue_capacity.
+	 */
+	UFUNCTION(BlueprintPure, Category="Discord|Cluster")
+	FEventQueueStats GetMessageQueueStats() const;
+
+	/**
+	 * @brief Measure how much memory D++'s caches are using. By default this only counts objects and containers, which is cheap and safe.
+	 * @param deep Also size every object's strings and lists and fill in the per guild breakdown. D++ changes those from the shard threads
+	 * without a lock, so the result is a racy estimate, and it walks every cached object on the GameThread.
+	 */
+	UFUNCTION(BlueprintCallable, Category="Discord|Cache")
+	FCacheMemoryStats GetCacheMemoryStats(bool deep = false) const;
 	
 #pragma endregion
 
+#pragma region Properties
+
+	/**
+	 * @brief The maximum amount of queued interactions (slash commands, button clicks) to dispatch each frame. Anything left over is dispatched next frame.
+	 * @note Zero or less means there is no limit. Messages don't count towards this, see max_messages_per_frame.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Discord|Cluster")
+	int32 max_events_per_frame = 256;
+
+	/**
+	 * @brief How many interactions can be waiting for the GameThread before new ones are dropped.
+	 * @note This is only applied when calling CreateBot or StartBot, and only once any previous bot has finished shutting down.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Discord|Cluster")
+	int32 event_queue_capacity = 4096;
+
+	/**
+	 * @brief The maximum amount of queued messages to dispatch each frame, after every waiting interaction. Anything left over is dispatched next frame.
+	 * @note Zero or less means there is no limit.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Discord|Cluster")
+	int32 max_messages_per_frame = 256;
+
+	/**
+	 * @brief How many messages can be waiting for the GameThread before new ones are dropped.
+	 * A full message queue never drops interactions, they have their own queue.
+	 * @note This is only applied when calling CreateBot or StartBot, and only once any previous bot has finished shutting down.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Discord|Cluster")
+	int32 message_queue_capacity = 4096;
+
+	/**
+	 * @brief Should messages be delivered in one batch per frame through OnMessagesCreated, instead of one OnMessageCreate per message?
+	 * Turn this on for bots in busy channels. Every message is still delivered, this only cuts down the Blueprint calls.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Discord|Cluster")
+	bool batch_message_delivery = false;
+
+	/**
+	 * @brief How many threads this bot uses for REST requests to Discord.
+	 * Every bot has its own, so lower this when running several bots in one process.
+	 * @note This is only applied when the cluster is created (CreateBot, or StartBot after StopBot).
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Discord|Cluster", meta=(ClampMin=1))
+	int32 rest_request_threads = 12;
+
+	/**
+	 * @brief Should gateway traffic be zlib-stream compressed? Compression saves bandwidth, but every event has to be inflated before it's parsed.
+	 * Turn this off on a fast, unmetered link to skip the inflate cost, which is highest during big GUILD_CREATE bursts.
+	 * @note This is only applied when the cluster is created (CreateBot, or StartBot after StopBot).
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Discord|Cluster")
+	bool compress_gateway = true;
+
+	/**
+	 * @brief How many shards (gateway connections) this bot opens. Zero uses the count Discord recommends for the bot.
+	 * Every shard is its own connection and thread, so small bots running alongside others in one process can set this to 1.
+	 * @note This is only applied when the cluster is created (CreateBot, or StartBot after StopBot).
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Discord|Cluster", meta=(ClampMin=0))
+	int32 shard_count = 0;
+
+	/**
+	 * @brief Should slash commands that aren't replied to in time be deferred? Discord drops interactions that aren't answered within 3 seconds.
+	 * A deferred command shows as "thinking" until OnSlashcommand's reply is ready, which is then sent as an edit.
+	 * @note This is only applied when calling StartBot.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Discord|Commands")
+	bool auto_defer_replies = true;
+
+	/**
+	 * @brief How many seconds the GameThread gets to reply to a slash command before it's deferred. Keep it well under 3, the deferral has to reach Discord too.
+	 * @note This is only applied when calling StartBot.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Discord|Commands", meta=(ClampMin=0, ClampMax=2.9))
+	float defer_reply_after_seconds = 2.0f;
+
+	/**
+	 * @brief Should deferred replies only be shown to the user who ran the command?
+	 * Discord decides this when deferring, so the reply's own isEmpherial is ignored once a command is deferred.
+	 * @note This is only applied when calling StartBot.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Discord|Commands")
+	bool defer_replies_ephemeral = false;
+
+	/**
+	 * @brief How often (in seconds) to measure D++'s caches in the background and fire OnCacheMemoryStats while the bot is running.
+	 * @note Zero or less turns it off.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Discord|Cache")
+	float cache_stats_interval_seconds = 0.0f;
+
+	/**
+	 * @brief Should the background measurement walk every cached object, see GetCacheMemoryStats?
+	 * @note The deep walk reads objects that D++ changes without a lock, so its numbers are only a rough estimate.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Discord|Cache")
+	bool cache_stats_deep = false;
+
+	/**
+	 * @brief What this bot keeps in D++'s caches. Use GetCacheMemoryStats to see what each cache costs before turning it down.
+	 * @note This is only applied when the cluster is created (CreateBot, or StartBot after StopBot).
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Discord|Cache")
+	FCachePolicy cache_policy;
+
+	/**
+	 * @brief How many seconds of audio to send ahead of what's playing. Higher survives hitches better, lower keeps memory down.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Discord|Audio", meta=(ClampMin=0.06))
+	float voice_lookahead_seconds = 0.3f;
+
+	/**
+	 * @brief How much memory (in MB) played sounds can keep in the voice cache. Sounds are kept as the Opus packets that get sent, so replaying them skips decoding and encoding.
+	 * @note Zero turns the cache off. A second of audio takes about 8KB.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Discord|Audio", meta=(ClampMin=0))
+	int32 voice_cache_budget_mb = 64;
+
+	/**
+	 * @brief How much memory (in MB) recently sent attachments can keep, so sending the same file again skips reading it.
+	 * @note Zero turns the cache off.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Discord|Messages", meta=(ClampMin=0))
+	int32 attachment_cache_budget_mb = 32;
+
+	/**
+	 * @brief How long (in seconds) a message delete waits for others in the same channel, so they can be sent as one bulk delete.
+	 * @note Zero still batches deletes made in the same frame.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Discord|Messages", meta=(ClampMin=0))
+	float delete_batch_window_seconds = 0.05f;
+
+#pragma endregion
+
 #pragma region Delegates
 
 	UPROPERTY(BlueprintAssignable, Category="Discord|Events")
@@ -376,23 +1028,216 @@ public:
 
 	UPROPERTY(BlueprintAssignable, Category="Discord|Events")
 	FOnMessageCreate OnMessageCreate;
+
+	/**
+	 * @brief Fired once per frame with every message that arrived since the last frame.
+	 * @note Only fired when batch_message_delivery is enabled, OnMessageCreate is not fired in that case.
+	 */
+	UPROPERTY(BlueprintAssignable, Category="Discord|Events")
+	FOnMessagesCreated OnMessagesCreated;
 	
 	UPROPERTY(BlueprintAssignable, Category="Discord|Events")
 	FOnButtonClick OnButtonClick;
 
+	/**
+	 * @brief Fired every cache_stats_interval_seconds with how much memory D++'s caches are using.
+	 */
+	UPROPERTY(BlueprintAssignable, Category="Discord|Events")
+	FOnCacheMemoryStats OnCacheMemoryStats;
+
 #pragma endregion
 
 private:
 
-	void CommenceAudioSend(const dpp::voiceconn* Voiceconn, const USoundWave* SoundWave);
+	/**
+	 * @brief Stop every voice stream and wait for them. Must be done before the shard they send through goes away.
+	 */
+	void StopVoiceStreams();
+
+	/**
+	 * @brief Push an event for the GameThread. Called from the shard threads.
+	 * @param generation The cluster_generation of the cluster that fired the event.
+	 * @return False if the queue was full and the event got dropped.
+	 */
+	bool QueueEvent(uint32 generation, FClusterQueuedEvent&& event);
+
+	/**
+	 * @brief Push a message for the GameThread. Called from the shard threads.
+	 * @return False if the message queue was full and the message got dropped.
+	 */
+	bool QueueMessage(uint32 generation, FMessage_event&& event);
+
+	/**
+	 * @brief Dispatch the queued interactions, up to max_events_per_frame, then the queued messages, up to max_messages_per_frame.
+	 * Interactions go first so that a busy channel can never push them past Discord's reply deadline.
+	 */
+	void DrainEventQueue();
+
+	void DispatchSlashcommand(const FSlashcommand_Event& command_event);
+
+	/**
+	 * @brief The shard of this bot's cluster that a guild's gateway events, and so its voice connection, go through.
+	 * @return nullptr if the bot isn't ready.
+	 */
+	dpp::discord_client* GetGuildShard(FDiscordSnowflake GuildID) const;
+
+	/**
+	 * @brief Events translated on the shard threads, waiting to be dispatched on the GameThread.
+	 */
+	TDppEventRing<FClusterQueueEntry> event_queue;
+
+	uint64 events_dispatched = 0;
+
+	/**
+	 * @brief Messages translated on the shard threads. Kept apart from event_queue so messages can't crowd interactions out.
+	 */
+	TDppEventRing<FClusterMessageEntry> message_queue;
+
+	uint64 messages_dispatched = 0;
+
+	/**
+	 * @brief Messages collected during a drain when batch_message_delivery is on. Kept around so the allocation is reused every frame.
+	 */
+	TArray<FMessage_event> message_batch;
+
+	/**
+	 * @brief Measure the caches in the background if cache_stats_interval_seconds has passed, then fire OnCacheMemoryStats.
+	 */
+	void TickCacheStats(float DeltaTime);
+
+	float cache_stats_elapsed = 0.0f;
+
+	/**
+	 * @brief Is a measurement still running? A slow one is never overlapped by the next.
+	 */
+	bool cache_stats_in_flight = false;
+
+	/**
+	 * @brief Create the cluster and bind its events, using the token and intents from CreateBot.
+	 */
+	void SetupCluster();
+
+	/**
+	 * @brief A started cluster and the thread running it, kept until the cluster has been shut down and deleted.
+	 */
+	struct FBotRun
+	{
+		std::thread thread;
+
+		/**
+		 * @brief Wakes the thread up when StopBot is called.
+		 */
+		std::mutex mutex;
+		std::condition_variable cv;
+		bool stop = false;
+
+		/**
+		 * @brief Set by the thread once the cluster has been shut down and deleted, so joining it won't block.
+		 */
+		std::atomic<bool> finished{false};
+	};
+
+	/**
+	 * @brief Join and clean up the runs that have finished shutting down.
+	 * @param wait Join every run, even ones that are still shutting down. Only for when the object is being destroyed.
+	 */
+	void ReapBotRuns(bool wait);
+
+	/**
+	 * @brief Apply event_queue_capacity and message_queue_capacity, if nothing could be pushing to the queues.
+	 */
+	void ResizeEventQueues();
 
 	UPROPERTY()
 	TArray<FSlashcommand_Data> commands_to_register;
 
-	std::atomic<bool> stop_bot;
+	/**
+	 * @brief The cluster this object owns. Once the bot is started, the bot thread owns it instead.
+	 */
+	dpp::cluster* clusterRef = nullptr;
+
+	/**
+	 * @brief The last shard that fired on_ready. Only touched on the GameThread, set when the ready event is dispatched.
+	 * @note With more than one shard this isn't necessarily the shard a guild is on, voice goes through GetGuildShard.
+	 */
+	dpp::discord_client* bot_client = nullptr;
+
+	/**
+	 * @brief Bumped every time a cluster is created. Handlers capture it, so anything queued by an older cluster can be told apart and dropped.
+	 */
+	uint32 cluster_generation = 0;
+
+	/**
+	 * @brief The running bot. Null when it isn't running.
+	 */
+	TUniquePtr<FBotRun> bot_run;
+
+	/**
+	 * @brief Stopped bots whose clusters are still shutting down. Joined from Tick once they're done, so restarting never waits on them.
+	 */
+	TArray<TUniquePtr<FBotRun>> stopping_runs;
+
+	/**
+	 * @brief The audio currently being streamed, by guild id.
+	 */
+	TMap<FDiscordSnowflake, TSharedPtr<FDppVoiceStream>> voice_streams;
+
+	/**
+	 * @brief Streams started by PrecacheSound, which only fill the cache.
+	 */
+	TArray<TSharedPtr<FDppVoiceStream>> precache_streams;
+
+	TSharedPtr<FDppVoiceCache, ESPMode::ThreadSafe> voice_cache;
+
+	TSharedPtr<FDppAttachmentCache, ESPMode::ThreadSafe> attachment_cache;
+
+	/**
+	 * @brief Defers slash commands the GameThread is too slow to reply to. Runs while the bot does.
+	 */
+	TSharedPtr<FDppReplyDeferrer, ESPMode::ThreadSafe> reply_deferrer;
+
+	TSharedPtr<FDppRestCoalescer, ESPMode::ThreadSafe> rest_coalescer;
+
+	/**
+	 * @brief Kept from CreateBot so the cluster can be recreated when restarting.
+	 */
+	std::string bot_token;
+
+	uint32_t bot_intents = 0;
 
 	// This is to stop UE from trying to destroy ClusterObject stuff when it's not alive.
-	std::atomic<bool> bot_alive;
+	std::atomic<bool> bot_alive{false};
 
+	/**
+	 * @brief A message from SendMessageToChannel, waiting for the ones before it in its channel.
+	 */
+	struct FChannelSend
+	{
+		/**
+		 * @brief Unset until its attachment has loaded.
+		 */
+		TOptional<dpp::message> msg;
+		FOnMessageSent callback;
+	};
+
+	/**
+	 * @brief Send every message at the front of the channel's queue that's ready, stopping at the first that isn't.
+	 */
+	void FlushChannelSends(uint64 channel_id);
+
+	/**
+	 * @brief Messages waiting to be sent, by channel id. Only touched by the GameThread.
+	 */
+	TMap<uint64, TArray<TSharedRef<FChannelSend>>> channel_sends;
+
+	/**
+	 * @brief Build the DPP message, without its attachment.
+	 */
 	dpp::message GenerateDPPMessage(const FDiscordMessage& discord_message);
+
+	/**
+	 * @brief Build the DPP message, loading its attachment (if any) off the GameThread.
+	 * @param on_generated Called on the GameThread with the message. Called straight away if there's no attachment, never called if this object is destroyed first.
+	 */
+	void GenerateDPPMessageAsync(const FDiscordMessage& discord_message, TUniqueFunction<void(dpp::message&&)>&& on_generated);
 };
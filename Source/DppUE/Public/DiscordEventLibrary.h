@@ -0,0 +1,75 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Kismet/BlueprintFunctionLibrary.h"
+#include "ClusterObject.h"
+
+#include "DiscordEventLibrary.generated.h"
+
+/**
+ * @brief Blueprint access to the event structs.
+ * Event strings are kept as UTF-8 and are only converted to FStrings when one of these is called.
+ */
+UCLASS()
+class DPPUE_API UDiscordEventLibrary : public UBlueprintFunctionLibrary
+{
+	GENERATED_BODY()
+
+public:
+
+#pragma region Slashcommand
+
+	UFUNCTION(BlueprintPure, Category="Discord|Events|Command", meta=(NativeMakeFunc))
+	static FSlashcommand_Event MakeSlashcommandEvent(const FString& command_name, const FString& issuing_user, FDiscordSnowflake issuing_user_id);
+
+	UFUNCTION(BlueprintPure, Category="Discord|Events|Command", meta=(NativeBreakFunc))
+	static void BreakSlashcommandEvent(const FSlashcommand_Event& event, FString& command_name, FString& issuing_user, FDiscordSnowflake& issuing_user_id);
+
+	UFUNCTION(BlueprintPure, Category="Discord|Events|Command")
+	static FString GetCommandName(const FSlashcommand_Event& event);
+
+	UFUNCTION(BlueprintPure, Category="Discord|Events|Command")
+	static FString GetCommandIssuingUser(const FSlashcommand_Event& event);
+
+#pragma endregion
+
+#pragma region ButtonClick
+
+	UFUNCTION(BlueprintPure, Category="Discord|Events|Button", meta=(NativeMakeFunc))
+	static FButtonClick_Event MakeButtonClickEvent(const FString& custom_id, const FString& issuing_user, FDiscordSnowflake issuing_user_id);
+
+	UFUNCTION(BlueprintPure, Category="Discord|Events|Button", meta=(NativeBreakFunc))
+	static void BreakButtonClickEvent(const FButtonClick_Event& event, FString& custom_id, FString& issuing_user, FDiscordSnowflake& issuing_user_id);
+
+	UFUNCTION(BlueprintPure, Category="Discord|Events|Button")
+	static FString GetButtonCustomId(const FButtonClick_Event& event);
+
+	UFUNCTION(BlueprintPure, Category="Discord|Events|Button")
+	static FString GetButtonIssuingUser(const FButtonClick_Event& event);
+
+#pragma endregion
+
+#pragma region Message
+
+	/**
+	 * @brief Make a message event. The content is taken from the message.
+	 */
+	UFUNCTION(BlueprintPure, Category="Discord|Events|Message", meta=(NativeMakeFunc))
+	static FMessage_event MakeMessageEvent(const FDiscordMessage& message, const FString& message_creator, FDiscordSnowflake message_creator_id);
+
+	/**
+	 * @brief Break a message event. The message output has its content filled in.
+	 */
+	UFUNCTION(BlueprintPure, Category="Discord|Events|Message", meta=(NativeBreakFunc))
+	static void BreakMessageEvent(const FMessage_event& event, FDiscordMessage& message, FString& message_creator, FDiscordSnowflake& message_creator_id);
+
+	UFUNCTION(BlueprintPure, Category="Discord|Events|Message")
+	static FString GetMessageContent(const FMessage_event& event);
+
+	UFUNCTION(BlueprintPure, Category="Discord|Events|Message")
+	static FString GetMessageCreator(const FMessage_event& event);
+
+#pragma endregion
+};
@@ -0,0 +1,45 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Kismet/BlueprintFunctionLibrary.h"
+#include "ClusterObject.h"
+
+#include "DiscordSnowflakeLibrary.generated.h"
+
+/**
+ * @brief Blueprint access to FDiscordSnowflake.
+ * Snowflakes are stored as numbers, Blueprints only see them as strings when making, breaking or converting them.
+ */
+UCLASS()
+class DPPUE_API UDiscordSnowflakeLibrary : public UBlueprintFunctionLibrary
+{
+	GENERATED_BODY()
+
+public:
+
+	UFUNCTION(BlueprintPure, Category="Discord|Snowflake", meta=(NativeMakeFunc))
+	static FDiscordSnowflake MakeSnowflake(const FString& snowflake_id);
+
+	UFUNCTION(BlueprintPure, Category="Discord|Snowflake", meta=(NativeBreakFunc))
+	static void BreakSnowflake(const FDiscordSnowflake& snowflake, FString& snowflake_id);
+
+	UFUNCTION(BlueprintPure, Category="Discord|Snowflake", meta=(DisplayName="To String (Snowflake)", CompactNodeTitle="->", BlueprintAutocast))
+	static FString Conv_SnowflakeToString(const FDiscordSnowflake& snowflake);
+
+	UFUNCTION(BlueprintPure, Category="Discord|Snowflake", meta=(DisplayName="To Snowflake (String)", CompactNodeTitle="->", BlueprintAutocast))
+	static FDiscordSnowflake Conv_StringToSnowflake(const FString& snowflake_id);
+
+	UFUNCTION(BlueprintPure, Category="Discord|Snowflake", meta=(DisplayName="Equal (Snowflake)", CompactNodeTitle="=="))
+	static bool EqualEqual_SnowflakeSnowflake(const FDiscordSnowflake& a, const FDiscordSnowflake& b);
+
+	UFUNCTION(BlueprintPure, Category="Discord|Snowflake", meta=(DisplayName="Not Equal (Snowflake)", CompactNodeTitle="!="))
+	static bool NotEqual_SnowflakeSnowflake(const FDiscordSnowflake& a, const FDiscordSnowflake& b);
+
+	/**
+	 * @brief Is the snowflake set? Snowflakes that failed to parse are empty.
+	 */
+	UFUNCTION(BlueprintPure, Category="Discord|Snowflake")
+	static bool IsValidSnowflake(const FDiscordSnowflake& snowflake);
+};
@@ -0,0 +1,154 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include <atomic>
+
+#include "CoreMinimal.h"
+
+/**
+ * @brief A bounded, lock-free multi-producer single-consumer ring.
+ *
+ * Shard threads push pre-translated event records into this, and the GameThread pops them once per frame.
+ * Every slot is allocated up front, so pushing never touches the allocator or the task graph.
+ * If the ring is full, the push fails and is counted so the caller can apply backpressure.
+ *
+ * @note Only one thread may ever call Pop at a time. Any number of threads may call Push.
+ */
+template<typename T>
+class TDppEventRing
+{
+public:
+
+	explicit TDppEventRing(const uint32 capacity = 4096)
+	{
+		Reset(capacity);
+	}
+
+	TDppEventRing(const TDppEventRing&) = delete;
+	TDppEventRing& operator=(const TDppEventRing&) = delete;
+
+	/**
+	 * @brief Reallocate the ring. The capacity is rounded up to a power of two.
+	 * @warning Not thread safe. Only call this when nothing can push or pop (e.g. before the bot starts).
+	 */
+	void Reset(const uint32 capacity)
+	{
+		const uint32 rounded = FMath::RoundUpToPowerOfTwo(FMath::Max<uint32>(capacity, 2));
+
+		slots = MakeUnique<FSlot[]>(rounded);
+
+		for(uint32 i = 0; i < rounded; ++i)
+		{
+			slots[i].sequence.store(i, std::memory_order_relaxed);
+		}
+
+		mask = rounded - 1;
+		enqueue_pos.store(0, std::memory_order_relaxed);
+		dequeue_pos.store(0, std::memory_order_relaxed);
+		pushed.store(0, std::memory_order_relaxed);
+		dropped.store(0, std::memory_order_relaxed);
+		high_watermark.store(0, std::memory_order_relaxed);
+	}
+
+	/**
+	 * @brief Push a record into the ring.
+	 * @return False if the ring is full. The record is left untouched and the drop counter is incremented.
+	 */
+	bool Push(T&& value)
+	{
+		FSlot* slot;
+		uint64 pos = enqueue_pos.load(std::memory_order_relaxed);
+
+		for(;;)
+		{
+			slot = &slots[pos & mask];
+			const uint64 seq = slot->sequence.load(std::memory_order_acquire);
+			const int64 diff = static_cast<int64>(seq) - static_cast<int64>(pos);
+
+			if(diff == 0)
+			{
+				if(enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					break;
+			} else if(diff < 0)
+			{
+				dropped.fetch_add(1, std::memory_order_relaxed);
+				return false;
+			} else
+			{
+				pos = enqueue_pos.load(std::memory_order_relaxed);
+			}
+		}
+
+		slot->value = MoveTemp(value);
+		slot->sequence.store(pos + 1, std::memory_order_release);
+
+		pushed.fetch_add(1, std::memory_order_relaxed);
+
+		// Racy by design, this is only a statistic.
+		const uint64 pending = pos + 1 - dequeue_pos.load(std::memory_order_relaxed);
+		uint64 watermark = high_watermark.load(std::memory_order_relaxed);
+		while(pending > watermark && !high_watermark.compare_exchange_weak(watermark, pending, std::memory_order_relaxed)) {}
+
+		return true;
+	}
+
+	/**
+	 * @brief Pop the oldest record from the ring. Must only be called from the consuming thread.
+	 * @return False if the ring is empty.
+	 */
+	bool Pop(T& out)
+	{
+		const uint64 pos = dequeue_pos.load(std::memory_order_relaxed);
+		FSlot& slot = slots[pos & mask];
+
+		if(slot.sequence.load(std::memory_order_acquire) != pos + 1)
+			return false;
+
+		out = MoveTemp(slot.value);
+		slot.value = T();
+		slot.sequence.store(pos + mask + 1, std::memory_order_release);
+		dequeue_pos.store(pos + 1, std::memory_order_relaxed);
+
+		return true;
+	}
+
+	bool IsEmpty() const
+	{
+		return Num() == 0;
+	}
+
+	/**
+	 * @brief An approximate amount of records waiting to be popped.
+	 */
+	uint64 Num() const
+	{
+		const uint64 tail = dequeue_pos.load(std::memory_order_relaxed);
+		const uint64 head = enqueue_pos.load(std::memory_order_relaxed);
+		return head > tail ? head - tail : 0;
+	}
+
+	uint32 Capacity() const { return mask + 1; }
+	uint64 NumPushed() const { return pushed.load(std::memory_order_relaxed); }
+	uint64 NumDropped() const { return dropped.load(std::memory_order_relaxed); }
+	uint64 HighWatermark() const { return high_watermark.load(std::memory_order_relaxed); }
+
+private:
+
+	struct FSlot
+	{
+		std::atomic<uint64> sequence{0};
+		T value;
+	};
+
+	TUniquePtr<FSlot[]> slots;
+	uint32 mask = 0;
+
+	// Producers and the consumer hammer different ends, keep them on separate cache lines.
+	alignas(PLATFORM_CACHE_LINE_SIZE) std::atomic<uint64> enqueue_pos{0};
+	alignas(PLATFORM_CACHE_LINE_SIZE) std::atomic<uint64> dequeue_pos{0};
+
+	alignas(PLATFORM_CACHE_LINE_SIZE) std::atomic<uint64> pushed{0};
+	std::atomic<uint64> dropped{0};
+	std::atomic<uint64> high_watermark{0};
+};
@@ -0,0 +1,131 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "CoreMinimal.h"
+
+THIRD_PARTY_INCLUDES_START
+#include <dpp/dpp.h>
+THIRD_PARTY_INCLUDES_END
+
+/**
+ * @brief Sits in front of a cluster's REST calls and cuts down how many actually get sent.
+ *
+ * Identical requests that are already in flight share the one request, and every caller gets its result.
+ * Message deletes are held for a short window and sent as one message_delete_bulk per channel where Discord allows it.
+ * Every caller still gets called back exactly once, through the usual command_completion_event_t.
+ *
+ * Safe to call from any thread. Get one from UClusterObject::GetRestCoalescer.
+ */
+class DPPUE_API FDppRestCoalescer : public TSharedFromThis<FDppRestCoalescer, ESPMode::ThreadSafe>
+{
+public:
+
+	/**
+	 * @brief Set the cluster to send through. Setting it to nullptr fails everything still waiting for a result.
+	 */
+	void SetCluster(dpp::cluster* cluster);
+
+	/**
+	 * @brief How long deletes wait for others in the same channel before being sent.
+	 */
+	void SetBatchWindow(double seconds);
+
+	void user_get(dpp::snowflake user_id, dpp::command_completion_event_t callback);
+
+	void guild_get_member(dpp::snowflake guild_id, dpp::snowflake user_id, dpp::command_completion_event_t callback);
+
+	/**
+	 * @brief Adding the same role to the same member twice does nothing, so repeats while one is in flight share it.
+	 */
+	void guild_member_add_role(dpp::snowflake guild_id, dpp::snowflake user_id, dpp::snowflake role_id, dpp::command_completion_event_t callback = dpp::utility::log_error());
+
+	/**
+	 * @brief Delete a message. Merged with other deletes in the same channel into message_delete_bulk when possible.
+	 */
+	void message_delete(dpp::snowflake message_id, dpp::snowflake channel_id, dpp::command_completion_event_t callback = dpp::utility::log_error());
+
+	/**
+	 * @brief Send the deletes whose window has passed. Called every frame by the owning UClusterObject.
+	 */
+	void Flush();
+
+	bool HasPendingDeletes() const;
+
+	struct FStats
+	{
+		/**
+		 * @brief Calls that shared a request already in flight.
+		 */
+		uint64 coalesced = 0;
+
+		/**
+		 * @brief Deletes that were sent as part of a bulk delete.
+		 */
+		uint64 bulk_deleted = 0;
+
+		/**
+		 * @brief Requests actually sent to Discord.
+		 */
+		uint64 sent = 0;
+	};
+
+	FStats GetStats() const;
+
+private:
+
+	/**
+	 * @brief Send a request, unless one with the same key is in flight, in which case the callback waits for that one instead.
+	 * @param send Sends the request, completing through the callback it's given.
+	 */
+	void SendShared(std::string key, dpp::command_completion_event_t callback, TFunction<void(dpp::cluster&, dpp::command_completion_event_t)>&& send);
+
+	/**
+	 * @brief Send a channel's waiting deletes. Expects the lock to be held, sending only queues the requests in D++.
+	 */
+	void SendDeletes(dpp::snowflake channel_id);
+
+	/**
+	 * @brief Take the callbacks of everything still waiting, so they can be failed. Expects the lock to be held.
+	 */
+	std::vector<dpp::command_completion_event_t> TakePending();
+
+	struct FPendingDeletes
+	{
+		/**
+		 * @brief The same message can be deleted twice before the window closes, so callbacks are kept per message.
+		 */
+		std::unordered_map<dpp::snowflake, std::vector<dpp::command_completion_event_t>> messages;
+
+		double first_queued_seconds = 0.0;
+	};
+
+	mutable FCriticalSection lock;
+
+	dpp::cluster* cluster = nullptr;
+
+	double batch_window = 0.05;
+
+	struct FInFlight
+	{
+		/**
+		 * @brief Unique per request sent. A late callback from a cluster that has since been replaced carries an old ticket,
+		 * so it can't complete a newer request with the same key.
+		 */
+		uint64 ticket = 0;
+
+		std::vector<dpp::command_completion_event_t> callbacks;
+	};
+
+	std::unordered_map<std::string, FInFlight> in_flight;
+
+	uint64 next_ticket = 0;
+
+	std::unordered_map<dpp::snowflake, FPendingDeletes> pending_deletes;
+
+	FStats stats;
+};
@@ -0,0 +1,89 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <string_view>
+
+#include "CoreMinimal.h"
+
+namespace DppUE
+{
+	/**
+	 * @brief Convert UTF-8 from DPP into an FString with a single allocation.
+	 */
+	DPPUE_API FString Utf8ToFString(std::string_view utf8);
+
+	/**
+	 * @brief Convert an FString into an owned UTF-8 string with a single, exactly sized allocation.
+	 */
+	DPPUE_API std::string ToUtf8(const FString& str);
+
+	/**
+	 * @brief Convert an FString into a thread-local UTF-8 scratch buffer. The buffer's memory is reused between calls.
+	 * Use this when DPP copies the string anyway (e.g. setters taking a const std::string&).
+	 * @warning The returned reference is only valid until the next call on the same thread, never hold onto it.
+	 */
+	DPPUE_API const std::string& ToUtf8Scratch(const FString& str);
+}
+
+/**
+ * @brief A UTF-8 string that came from Discord, kept as-is until something actually reads it as an FString.
+ *
+ * Copies share the same buffer, so passing events around (queues, delegates, arrays) never copies the text.
+ * The FString is materialised once, on first read, and cached for every copy.
+ *
+ * Buffers come from a process-wide pool and go back to it once the last copy is gone, keeping their capacity.
+ * Once the pool has warmed up, translating an event on a shard thread copies the text into an existing buffer
+ * instead of allocating, and converting it on the GameThread reuses the FString's buffer the same way.
+ *
+ * @note Materialising is not thread safe. Only read the FString on one thread (the GameThread).
+ */
+struct DPPUE_API FDppUtf8String
+{
+	FDppUtf8String() = default;
+
+	FDppUtf8String(std::string&& utf8);
+
+	FDppUtf8String(const std::string& utf8);
+
+	FDppUtf8String(const FDppUtf8String& other);
+
+	FDppUtf8String(FDppUtf8String&& other) noexcept;
+
+	FDppUtf8String& operator=(const FDppUtf8String& other);
+
+	FDppUtf8String& operator=(FDppUtf8String&& other) noexcept;
+
+	~FDppUtf8String();
+
+	/**
+	 * @brief The original UTF-8 string, no conversion is done.
+	 */
+	const std::string& to_string() const;
+
+	/**
+	 * @brief The string as an FString. Converted on the first call, then cached.
+	 */
+	const FString& to_fstring() const;
+
+	bool is_empty() const;
+
+	/**
+	 * @brief Reference counted by hand, so the payload can go back to the pool instead of being freed.
+	 */
+	struct FPayload
+	{
+		std::string utf8;
+		mutable FString converted;
+		mutable bool is_converted = false;
+		std::atomic<int32> ref_count{0};
+	};
+
+private:
+
+	void Release();
+
+	FPayload* payload = nullptr;
+};